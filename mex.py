@@ -0,0 +1,106 @@
+"""Python reader for mex shared-memory containers.
+
+Containers describe their record layout in the file header, so Python only
+needs the payload's NumPy dtype, matching T_Object field for field:
+
+    import numpy as np, mex
+    tick = np.dtype([('ask_px', '<u4'), ('ask_qx', '<u4'),
+                     ('bid_px', '<u4'), ('bid_qx', '<u4')])
+    c = mex.Container('/dev/shm/nse_tickers.shm', tick)
+    live = c.view()        # zero-copy, may show records mid-update
+    snap = c.snapshot()    # validated copy through libmex.so
+
+view() maps the records through the buffer protocol, with version_a and
+version_b next to the payload; a row whose two versions differ is being
+written. snapshot() uses the seqlock-validated bulk copy of the C ABI, which
+also checks the header's wrap epoch for 8/16-bit versions.
+Build the library next to this file:
+    g++ -std=c++17 -O2 -shared -fPIC shm.cpp -o libmex.so
+"""
+import ctypes
+import mmap
+import os
+import struct
+
+LAYOUT_MAGIC = 0x4d455831
+LAYOUT_FIELDS = ('magic', 'layout_version', 'header_size', 'record_stride',
+                 'payload_offset', 'payload_size', 'version_a_offset',
+                 'version_b_offset', 'version_size', 'crc_offset', 'size_offset',
+                 'capacity_offset', 'user_header_offset', 'user_header_size')
+
+
+class Layout(ctypes.Structure):
+    _fields_ = [(name, ctypes.c_uint32) for name in LAYOUT_FIELDS] + \
+               [('history_depth', ctypes.c_uint16), ('flags', ctypes.c_uint16),
+                ('epoch_offset', ctypes.c_uint32)]
+
+
+def _load_library(path=None):
+    path = path or os.environ.get('MEX_LIB') or \
+        os.path.join(os.path.dirname(os.path.abspath(__file__)), 'libmex.so')
+    lib = ctypes.CDLL(path, use_errno=True)
+    lib.mex_open.restype = ctypes.c_void_p
+    lib.mex_open.argtypes = [ctypes.c_char_p]
+    lib.mex_close.argtypes = [ctypes.c_void_p]
+    lib.mex_size.restype = ctypes.c_uint64
+    lib.mex_size.argtypes = [ctypes.c_void_p]
+    lib.mex_copy_committed.restype = ctypes.c_uint64
+    lib.mex_copy_committed.argtypes = [ctypes.c_void_p, ctypes.c_uint64, ctypes.c_uint64,
+                                       ctypes.c_void_p, ctypes.c_void_p]
+    return lib
+
+
+class Container:
+    def __init__(self, path, dtype, lib_path=None):
+        import numpy as np
+        self._np = np
+        with open(path, 'rb') as f:
+            self._mm = mmap.mmap(f.fileno(), 0, prot=mmap.PROT_READ)
+        self.layout = Layout.from_buffer_copy(self._mm[:ctypes.sizeof(Layout)])
+        lay = self.layout
+        if lay.magic != LAYOUT_MAGIC:
+            raise ValueError('%s is not a mex container' % path)
+        self.dtype = np.dtype(dtype)
+        if self.dtype.itemsize != lay.payload_size:
+            raise ValueError('dtype is %d bytes, records hold %d' % (self.dtype.itemsize, lay.payload_size))
+        ver = '<u%d' % lay.version_size
+        self.record_dtype = np.dtype({'names': ['payload', 'version_a', 'version_b'],
+                                      'formats': [self.dtype, ver, ver],
+                                      'offsets': [lay.payload_offset, lay.version_a_offset,
+                                                  lay.version_b_offset],
+                                      'itemsize': lay.record_stride})
+        self._path = path
+        self._lib_path = lib_path
+        self._lib = None
+        self._handle = None
+
+    def size(self):
+        size, = struct.unpack_from('<Q', self._mm, self.layout.size_offset)
+        return min(size, (len(self._mm) - self.layout.header_size) // self.layout.record_stride)
+
+    def view(self):
+        """Zero-copy records, unvalidated: payload, version_a, version_b."""
+        return self._np.ndarray(shape=(self.size(),), dtype=self.record_dtype,
+                                buffer=self._mm, offset=self.layout.header_size)
+
+    def snapshot(self, first=0, count=None, with_versions=False):
+        """Seqlock-validated copy, stops at the first unreadable record."""
+        if self._handle is None:
+            self._lib = _load_library(self._lib_path)
+            self._handle = self._lib.mex_open(self._path.encode())
+            if not self._handle:
+                err = ctypes.get_errno()
+                raise OSError(err, os.strerror(err), self._path)
+        if count is None:
+            count = max(0, self._lib.mex_size(self._handle) - first)
+        out = self._np.empty(count, dtype=self.dtype)
+        vers = self._np.empty(count, dtype='<u8') if with_versions else None
+        got = self._lib.mex_copy_committed(self._handle, first, count, out.ctypes.data,
+                                           vers.ctypes.data if with_versions else None)
+        return (out[:got], vers[:got]) if with_versions else out[:got]
+
+    def close(self):
+        if self._handle:
+            self._lib.mex_close(self._handle)
+            self._handle = None
+        self._mm.close()
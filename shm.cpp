@@ -2,10 +2,41 @@
 #include <memory>
 #include <atomic>
 #include <stdexcept>
+#include <algorithm>
+#include <limits>
 #include <string>
 #include <stdint.h>
 #include <assert.h>
 #include <x86intrin.h>
+#include <vector>
+#include <unordered_map>
+#include <functional>
+#include <tuple>
+#include <chrono>
+#include <thread>
+#include <system_error>
+#include <cstring>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sched.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+#include <linux/perf_event.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/resource.h>
+#include <linux/fs.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
 
 // Helpers
 template<class T>
@@ -14,37 +45,207 @@ inline constexpr bool CanMemCopy()
 struct NoHeaderInfo {};
 #define LIKELY(cond) __builtin_expect((bool)(cond), 1)
 
+// CRC32C (Castagnoli) using the SSE4.2 instruction, no -msse4.2 needed.
+__attribute__((target("sse4.2")))
+inline uint32_t crc32c(uint32_t seed, void const* data, size_t len)
+{
+    auto p = static_cast<unsigned char const*>(data);
+    uint64_t crc = ~seed;
+    for(; len >= 8; p += 8, len -= 8)
+        {
+        uint64_t chunk;
+        std::memcpy(&chunk, p, 8);
+        crc = _mm_crc32_u64(crc, chunk);
+        }
+    uint32_t crc32 = uint32_t(crc);
+    for(; len; ++p, --len)
+        crc32 = _mm_crc32_u8(crc32, *p);
+    return ~crc32;
+}
+struct NoChecksum {};
+struct Crc32cChecksum { uint32_t crc {}; };
+struct NoHistory {};
+struct NoDirtyMask {};
+struct DirtyFieldMask { uint64_t dirty {}; }; // fields changed by the last version
+
+// Compile-time field indices for per-field dirty masks. Opt in by listing
+// the members, each gets bit index_of() in the mask:
+//   template<> struct ShmFields<NseTicker>
+//       : FieldList<&NseTicker::ask_px, &NseTicker::ask_qx, ...> {};
+template<typename T_Object> struct ShmFields;
+
+template<typename T> struct MemberOf;
+template<typename C, typename M> struct MemberOf<M C::*>
+{
+    using object = C;
+    using type   = M;
+};
+
+template<auto A_Lhs, auto A_Rhs>
+constexpr bool same_member()
+{
+    if constexpr(std::is_same<decltype(A_Lhs), decltype(A_Rhs)>::value)
+        return A_Lhs == A_Rhs;
+    return false;
+}
+
+template<auto... A_Members>
+struct FieldList
+{
+    static constexpr size_t COUNT = sizeof...(A_Members);
+    static_assert(COUNT <= 64, "dirty masks hold 64 fields");
+
+    template<auto A_Member>
+    static constexpr size_t index_of()
+        {
+        size_t idx = 0, found = COUNT;
+        ((found = COUNT == found && same_member<A_Member, A_Members>() ? idx : found, ++idx), ...);
+        return found;
+        }
+};
+
+template<auto A_Member>
+constexpr uint64_t field_bit()
+{
+    using Fields = ShmFields<typename MemberOf<decltype(A_Member)>::object>;
+    constexpr size_t idx = Fields::template index_of<A_Member>();
+    static_assert(idx < Fields::COUNT, "member is not listed in ShmFields<T_Object>");
+    return uint64_t(1) << idx;
+}
+constexpr uint64_t ALL_FIELDS = ~uint64_t(0);
+struct ForwardEntry // compaction moved record `from` to `to` in generation gen
+{
+    uint64_t from;
+    uint64_t to;
+    uint64_t gen;
+};
+struct ScanConfig // see ShmContainerBase::scan()
+{
+    size_t readahead_bytes = 16 << 20; // kept requested ahead of the cursor
+    size_t step_bytes      = 2 << 20;  // granularity of the advice calls
+    bool   drop_behind     = true;     // release scanned pages, mapping and page cache
+};
+// Self-description at the start of every container file, for readers that
+// do not have T_Object: the C ABI (mex_*) and through it Python/NumPy.
+// Offsets are in bytes; record i starts at header_size + i * record_stride.
+struct ShmRecordLayout
+{
+    static constexpr uint32_t MAGIC   = 0x4d455831; // "MEX1"
+    static constexpr uint32_t VERSION = 2;
+    static constexpr uint32_t CHECKSUMMED = 1;      // flags
+
+    uint32_t magic;
+    uint32_t layout_version;
+    uint32_t header_size;
+    uint32_t record_stride;
+    uint32_t payload_offset;
+    uint32_t payload_size;
+    uint32_t version_a_offset;   // loaded first by readers, stored last by the producer
+    uint32_t version_b_offset;   // loaded last by readers, bumped first by the producer
+    uint32_t version_size;       // 1, 2, 4 or 8, top bit marks an erased record
+    uint32_t crc_offset;         // if CHECKSUMMED: CRC32C of the payload seeded with the version
+    uint32_t size_offset;        // committed record count, uint64_t in the header
+    uint32_t capacity_offset;
+    uint32_t user_header_offset;
+    uint32_t user_header_size;
+    uint16_t history_depth;
+    uint16_t flags;
+    uint32_t epoch_offset;       // version wrap counter, uint64_t, check it for versions < 4 bytes
+};
+static_assert(sizeof(ShmRecordLayout) == 64, "one cache line, part of the file format");
+
+template<typename T_Object, typename T_Version, size_t K>
+struct PayloadHistory // ring indexed by version % K, each slot its own seqlock
+{
+    struct Slot
+    {
+        std::atomic<T_Version> version {};
+        T_Object               payload {};
+    };
+    Slot history[K];
+};
+
 // This is the common base class for the producer and consumer sides.
 // Producer and Consumer will derive from this just to hide certain methods.
 template< typename T_Object                     // The contained object, main payload
         , typename T_Version    = uint32_t      // Version number of an object
         , typename T_UsrHeader  = NoHeaderInfo  // optional, maybe user needs metadata
         , size_t   A_Alignment  = std::alignment_of<T_Object>::value
+        , bool     A_Checksum   = false         // per-record CRC32C, see check_record()
+        , size_t   A_History    = 0             // keep the last K payloads, see copy_history()
+        , bool     A_DirtyMask  = false         // per-field change mask, see try_copy_changes()
         >
 class ShmContainerBase
 {
     static_assert(CanMemCopy<T_Object>(), "TObject must be mem-copyable");
     struct alignas(A_Alignment) Record;
+    template<typename, typename, typename, size_t, bool, size_t, bool>
+    friend class ShmWindowedConsumer; // maps Records, a window at a time
 public:
     // In a 64-bit process, the capacity can be quite huge: 1-256 TB.
     // Neither physical memory nor disk space will not be consumed
     // until data is actually written to it.
-    enum class eRole { PRODUCER, CONSUMER }; // for checking API usage
+    enum class eRole { PRODUCER, CONSUMER, PRIVATE_CLONE }; // for checking API usage
     ShmContainerBase(size_t capacity_num_records, std::string file_path, eRole);
 
     // API: Guranteed consistent, atomic read.
     struct VersionUnchecked : std::exception {};
+    struct ChecksumMismatch : std::exception {}; // checksummed containers only
     class ScopedConsume;
     ScopedConsume consume_begin(size_t obj_index)
-        {return ScopedConsume(&m_shared_mem->records[obj_index]);}
+        {return ScopedConsume(&m_shared_mem->records[obj_index], &m_shared_mem->hdr.version_epoch);}
 
     // API: Atomically update a record.
     class ScopedProduce;
     ScopedProduce produce_begin(size_t obj_index)
-        {return ScopedProduce(&m_shared_mem->records[obj_index]);}
+        {return ScopedProduce(&m_shared_mem->records[obj_index], &m_shared_mem->hdr.version_epoch);}
 
     ScopedProduce emplace_back()
-        { return produce_begin(m_shared_mem->hdr.size++);}
+        {
+        auto& hdr_size = m_shared_mem->hdr.size; // single producer: no RMW needed
+        auto const idx = hdr_size.load(std::memory_order_relaxed);
+        hdr_size.store(idx + 1, std::memory_order_release);
+        return produce_begin(idx);
+        }
+
+    // API: Erase leaves a tombstone (the version's top bit) and puts the
+    // slot on a lock-free free-list in the header, which emplace() reuses
+    // before growing the container. Erased records read as not committed.
+    void erase(size_t obj_index)
+        {
+        static_assert(sizeof(T_Object) >= sizeof(uint64_t), "free-list link lives in the payload");
+        Record& rec = m_shared_mem->records[obj_index];
+        if(rec.erased())
+            return;
+        rec.prod_erase(m_shared_mem->hdr.version_epoch);
+        push_free(obj_index);
+        }
+    ScopedProduce emplace(size_t& out_index)
+        {
+        if(!pop_free(out_index))
+            {
+            out_index = size();
+            return emplace_back();
+            }
+        m_shared_mem->records[out_index].prod_revive();
+        return produce_begin(out_index);
+        }
+    bool is_erased(size_t obj_index) const {return m_shared_mem->records[obj_index].erased();}
+    // API: Current version of a record, one load. A cheap "did it change"
+    // probe ahead of a copy, not a consistency check.
+    T_Version version(size_t obj_index) const {return m_shared_mem->records[obj_index].cons_begin();}
+    // Hint: start loading a record that will be read soon
+    void prefetch(size_t obj_index) const {__builtin_prefetch(&m_shared_mem->records[obj_index]);}
+
+    // API: Compaction, run by the producer. Moves the highest live records
+    // into the lowest free slots, logs each move as a ForwardEntry, then
+    // shrinks size() and releases the emptied tail pages. A consumer that
+    // cached an index together with compaction_gen() can resolve it later
+    // with ShmForwardingResolver. Returns records moved.
+    template<typename T_FwdLog> // ShmContainerProducer<ForwardEntry>
+    size_t compact(T_FwdLog& fwd_log, size_t max_moves = ~size_t(0));
+    uint64_t compaction_gen() const
+        {return m_shared_mem->hdr.compaction_gen.load(std::memory_order_acquire);}
 
     // Convenience method
     void push_back(T_Object const& obj)
@@ -54,13 +255,193 @@ public:
         prod.produce_commit();
         }
 
+    // API: Single attempt at a consistent copy, never blocks.
+    // Returns false if the record is being written or was never committed.
+    bool try_copy(size_t obj_index, T_Object& out, T_Version* out_ver = nullptr) const
+        {return copy_record(m_shared_mem->records[obj_index], m_shared_mem->hdr.version_epoch, out, out_ver);}
+
+    // API: Consistent copy plus which fields changed since the caller's
+    // copy at version io_ver (INVALID_VERSION: none yet), containers with
+    // A_DirtyMask. changed is the producer's mask when exactly one version
+    // passed, ALL_FIELDS when more did, and 0 with out untouched when none.
+    bool try_copy_changes(size_t obj_index, T_Object& out, T_Version& io_ver, uint64_t& changed) const
+        {
+        static_assert(A_DirtyMask, "container was not declared with A_DirtyMask");
+        Record const& rec = m_shared_mem->records[obj_index];
+        uint64_t const epoch = lap_epoch();
+        auto const ver = rec.cons_begin();
+        if(INVALID_VERSION == ver || (ver & Record::TOMBSTONE))
+            return false;
+        if(ver == io_ver && lap_epoch() == epoch)
+            {
+            changed = 0;
+            return rec.cons_commit() == ver;
+            }
+        std::memcpy(&out, &rec.payload, sizeof(T_Object));
+        uint32_t const crc  = rec.stored_crc();
+        uint64_t const mask = rec.stored_dirty();
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if(rec.cons_commit() != ver || lap_epoch() != epoch)
+            return false;
+        if(CHECKSUMMED && crc != Record::payload_crc(ver, out))
+            throw ChecksumMismatch();
+        changed = INVALID_VERSION != io_ver && Record::next_version(io_ver) == ver ? mask : ALL_FIELDS;
+        io_ver  = ver;
+        return true;
+        }
+
+    // API: Like try_copy, but reads only what proj touches, e.g. a timestamp,
+    // so ordering decisions do not copy whole records.
+    template<typename F, typename R>
+    bool try_project(size_t obj_index, F&& proj, R& out) const
+        {
+        Record const& rec = m_shared_mem->records[obj_index];
+        uint64_t const epoch = lap_epoch();
+        auto const ver = rec.cons_begin();
+        if(INVALID_VERSION == ver)
+            return false;
+        out = proj(rec.payload);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return rec.cons_commit() == ver && lap_epoch() == epoch;
+        }
+
+    // API: Bulk copy of consecutive committed records, for tailing.
+    // Stops at the first record that is not (yet) consistently readable.
+    size_t copy_committed(size_t first, size_t max_count, T_Object* out) const
+        {
+        size_t const last = std::min(first + max_count, size());
+        size_t idx = first;
+        for(; idx < last; ++idx)
+            if(!try_copy(idx, out[idx - first]) && !try_copy(idx, out[idx - first]))
+                {
+                if(!is_erased(idx))
+                    break; // retry once, a writer may just have been in the way
+                out[idx - first] = T_Object{}; // tailers see erased records as empty
+                }
+        return idx - first;
+        }
+
+    // API: Historical scan of [first, last), for files on disk. Keeps the
+    // kernel reading readahead_bytes ahead of the cursor (MADV_SEQUENTIAL,
+    // MADV_WILLNEED) and gives scanned pages back behind it: MADV_DONTNEED
+    // for the mapping, POSIX_FADV_DONTNEED so a backtest leaves the page
+    // cache to the live readers (pages in use elsewhere, or dirty, stay).
+    // on_record(index, obj) gets validated copies, erased records are
+    // skipped. Stops like copy_committed(); returns the records passed.
+    template<typename F>
+    size_t scan(size_t first, size_t last, F&& on_record, ScanConfig const& cfg = {}) const;
+
+    // API: History of in-place updated records, containers with A_History > 0.
+    // The value a record had at version ver, if it is still in the ring.
+    bool try_copy_version(size_t obj_index, T_Version ver, T_Object& out) const
+        {
+        static_assert(A_History > 0, "container was not declared with A_History");
+        auto const& slot = m_shared_mem->records[obj_index].history[ver % A_History];
+        if(INVALID_VERSION == ver || slot.version.load(std::memory_order_acquire) != ver)
+            return false;
+        std::memcpy(&out, &slot.payload, sizeof(T_Object));
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return slot.version.load(std::memory_order_relaxed) == ver;
+        }
+
+    // Up to A_History most recent values, newest first, with consecutive
+    // versions. Retries if the producer laps the ring while we copy.
+    size_t copy_history(size_t obj_index, T_Object* out, T_Version* out_ver = nullptr,
+                        size_t max_count = A_History) const
+        {
+        max_count = std::min(max_count, A_History);
+        size_t count = 0;
+        for(int attempt = 0; attempt < 4; ++attempt)
+            {
+            T_Version ver = m_shared_mem->records[obj_index].cons_begin();
+            for(count = 0; count < max_count && INVALID_VERSION != ver; ++count, ver = Record::prev_version(ver))
+                {
+                if(!try_copy_version(obj_index, ver, out[count]))
+                    break;
+                if(out_ver)
+                    out_ver[count] = ver;
+                }
+            if(count == max_count || INVALID_VERSION == ver)
+                break; // complete, or no older versions (history stops at a wrap)
+            }
+        return count;
+        }
+
+    // API: Verifies one record's CRC without throwing, for scrubbing.
+    enum class eCheck { OK, BUSY, UNWRITTEN, ERASED, CORRUPT };
+    eCheck check_record(size_t obj_index) const
+        {
+        static_assert(CHECKSUMMED, "container was not declared with A_Checksum");
+        T_Object copy;
+        try {
+            if(try_copy(obj_index, copy))
+                return eCheck::OK;
+            auto const& rec = m_shared_mem->records[obj_index];
+            if(rec.erased())
+                return eCheck::ERASED;
+            return INVALID_VERSION == rec.cons_begin() ? eCheck::UNWRITTEN : eCheck::BUSY;
+        } catch(ChecksumMismatch const&) {
+            return eCheck::CORRUPT;
+        }
+        }
+
+    // API: Durable mode for containers on a real filesystem. Flushes records
+    // first and only then the header that covers them, so a persisted
+    // durable_size never runs ahead of its records. Returns the durable size.
+    // Appends only, unless in-place updates must survive a reboot as well.
+    size_t sync_durable(bool include_in_place = false)
+        {
+        auto& hdr = m_shared_mem->hdr;
+        size_t const upto = size();
+        size_t const from = include_in_place ? 0 : hdr.durable_size.load(std::memory_order_relaxed);
+        msync_range(&m_shared_mem->records[from], &m_shared_mem->records[upto]);
+        hdr.durable_size.store(upto, std::memory_order_release);
+        msync_range(&hdr, &hdr + 1);
+        return upto;
+        }
+    size_t durable_size() const {return m_shared_mem->hdr.durable_size.load(std::memory_order_acquire);}
+
+    // Run by the producer at attach. Drops the uncommitted tail and torn
+    // records (version_a != version_b, or a bad CRC). After a reboot,
+    // anything beyond durable_size is dropped too: it may be torn at page
+    // granularity, and without A_Checksum that cannot be detected.
+    struct RecoveryReport
+    {
+        bool   after_reboot {};
+        size_t kept {};           // new size()
+        size_t dropped_tail {};   // cut off the end
+        size_t dropped_torn {};   // below size(), now unwritten
+    };
+    RecoveryReport recover(bool full_scan);
+    RecoveryReport const& last_recovery() const {return m_recovery;}
+
     // Optional. Maybe user needs to add meta-data to the container,
     T_UsrHeader& user_header() {return m_shared_mem->hdr.user_header;}
 
+    // API: What-if copy. A writable, detached container over a MAP_PRIVATE
+    // mapping of the file: O(1) to take, and only pages the clone writes
+    // get copied. Pages it has not written yet keep showing the live file,
+    // so take it while the producer is quiet or accept that blend; a
+    // record the producer was writing at that moment reads as busy until
+    // the clone rewrites it. clone_reflink() is point-in-time.
+    ShmContainerBase clone_private() const
+        {return ShmContainerBase(capacity(), m_file_path, eRole::PRIVATE_CLONE);}
+
+    // API: Persistent clone via FICLONE on filesystems that share extents
+    // (btrfs, XFS, ...); throws std::system_error (EOPNOTSUPP, EXDEV) on
+    // others. Attach a producer to the clone to repair torn records.
+    void clone_reflink(std::string const& clone_path) const;
+
+    // Record layout as seen by foreign readers, see the C ABI (mex_*)
+    ShmRecordLayout const& record_layout() const {return m_shared_mem->hdr.layout;}
+
 public: // Boilerplate standard container interface
+    using value_type   = T_Object;
+    using version_type = T_Version;
+    static constexpr bool CHECKSUMMED = A_Checksum;
 
-    size_t size() const;
-    size_t capacity() const;
+    size_t size() const     {return m_shared_mem->hdr.size.load(std::memory_order_acquire);}
+    size_t capacity() const {return m_shared_mem->hdr.capacity.load(std::memory_order_relaxed);}
 
     class iterator;
     class const_iterator;
@@ -74,33 +455,118 @@ public: // Boilerplate standard container interface
     ShmContainerBase() = default;
 
 private:
-    using vsize_t    = size_t; // Single-producer only
+    using vsize_t    = std::atomic<size_t>; // Single-producer only: load+store
     using version_t  = std::atomic<T_Version>;
     using refcount_t = std::atomic<size_t>;
     using has_prod_t = std::atomic<bool>;
     static constexpr T_Version INVALID_VERSION = 0;
 
+    // 8/16-bit versions can lap while a reader is preempted mid-copy, so
+    // their readers also compare the header epoch; 32-bit ones would need
+    // 2^31 updates of one record inside one read.
+    static constexpr bool LAPS_POSSIBLE = sizeof(T_Version) < sizeof(uint32_t);
+    static uint64_t lap_epoch(std::atomic<uint64_t> const& epoch)
+        {
+        if constexpr(LAPS_POSSIBLE)
+            return epoch.load(std::memory_order_acquire);
+        return 0;
+        }
+    uint64_t lap_epoch() const {return lap_epoch(m_shared_mem->hdr.version_epoch);}
+
     struct alignas(64) Header
     {
+        ShmRecordLayout layout {};   // written by the producer, checked by consumers
         vsize_t     size {};
         vsize_t     capacity {};
+        vsize_t     durable_size {}; // records known to be on stable storage
         version_t   accumulated_version {}; // increments when any record does
+        std::atomic<uint64_t> version_epoch {};  // bumped before any record's version wraps
+        std::atomic<uint64_t> free_head {};      // (tag << 40) | (index + 1), 0: empty
+        std::atomic<uint64_t> compaction_gen {};
         refcount_t  refcount {}; // producer + consumers
         bool        delete_file_after_last_ref {};
         has_prod_t  has_producer {}; // single-producer check
+        char        boot_id[40] {}; // kernel boot the producer last attached in
         T_UsrHeader user_header {};
     };
 
-    struct alignas(A_Alignment) Record
+    struct alignas(A_Alignment) Record // empty bases if the options are off
+        : std::conditional_t<A_Checksum, Crc32cChecksum, NoChecksum>
+        , std::conditional_t<(A_History > 0), PayloadHistory<T_Object, T_Version, A_History>, NoHistory>
+        , std::conditional_t<A_DirtyMask, DirtyFieldMask, NoDirtyMask>
     {
         T_Object    payload {};
         version_t   version_a {INVALID_VERSION};
         version_t   version_b {INVALID_VERSION};
 
+        static constexpr T_Version TOMBSTONE = T_Version(T_Version(1) << (8 * sizeof(T_Version) - 1));
+
         T_Version   cons_begin() const        {return version_a.load(std::memory_order_acquire);}
         T_Version   cons_commit() const       {return version_b.load(std::memory_order_acquire);}
-        T_Version   prod_begin()              {return ++version_b;}
-        void        prod_commit(T_Version vv) {version_a.store(vv, std::memory_order_release);}
+
+        // Versions run 1 .. TOMBSTONE - 1 and then wrap to 1, skipping
+        // INVALID_VERSION and the tombstone bit.
+        static T_Version next_version(T_Version vv)
+            {
+            T_Version const next = T_Version(T_Version(vv + 1) & T_Version(~TOMBSTONE));
+            return INVALID_VERSION == next ? T_Version(1) : next;
+            }
+        static T_Version prev_version(T_Version vv) // INVALID_VERSION before 1
+            {return vv > 1 ? T_Version(vv - 1) : INVALID_VERSION;}
+
+        // Announces a wrap in the header epoch before the wrapped version
+        // becomes visible, so readers can tell a lap from no change.
+        T_Version   prod_begin(std::atomic<uint64_t>& epoch)
+            {
+            T_Version const prev = T_Version(version_b.load(std::memory_order_relaxed) & T_Version(~TOMBSTONE));
+            T_Version const next = next_version(prev);
+            if(next < prev)
+                epoch.fetch_add(1);
+            version_b.store(next);
+            return next;
+            }
+        void        prod_commit(T_Version vv)
+            {
+            if constexpr(A_Checksum)
+                this->crc = payload_crc(vv, payload);
+            if constexpr(A_History > 0)
+                {
+                auto& slot = this->history[vv % A_History];
+                slot.version.store(INVALID_VERSION, std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_release);
+                std::memcpy(&slot.payload, &payload, sizeof(T_Object));
+                slot.version.store(vv, std::memory_order_release);
+                }
+            version_a.store(vv, std::memory_order_release);
+            }
+
+        bool        erased() const            {return cons_begin() & TOMBSTONE;}
+        void        prod_erase(std::atomic<uint64_t>& epoch)
+            {
+            T_Version const vv = T_Version(prod_begin(epoch) | TOMBSTONE);
+            version_b.store(vv);
+            std::memset((void*)&payload, 0, sizeof(T_Object));
+            version_a.store(vv, std::memory_order_release);
+            }
+        // Readers keep seeing the tombstone in version_a until the commit
+        void        prod_revive()
+            {version_b.store(version_b.load(std::memory_order_relaxed) & ~TOMBSTONE);}
+
+        // Seeded with the version, so a scribbled version is caught too
+        static uint32_t payload_crc(T_Version vv, T_Object const& obj)
+            {return crc32c(uint32_t(vv), &obj, sizeof(T_Object));}
+        uint32_t    stored_crc() const
+            {
+            if constexpr(A_Checksum)
+                return this->crc;
+            return 0;
+            }
+        uint64_t    stored_dirty() const
+            {
+            if constexpr(A_DirtyMask)
+                return this->dirty;
+            return ALL_FIELDS;
+            }
     };
 
     struct MemLayout
@@ -109,44 +575,437 @@ private:
         Record      records[];
     };
 
+    static constexpr uint64_t FREE_INDEX_MASK = (uint64_t(1) << 40) - 1;
+
+    // Treiber stack; the tag in the top bits defeats ABA. Links are kept
+    // in the (zeroed) payload of the erased record.
+    void push_free(size_t obj_index)
+        {
+        auto& head = m_shared_mem->hdr.free_head;
+        void* const link = &m_shared_mem->records[obj_index].payload;
+        uint64_t old_head = head.load(std::memory_order_relaxed);
+        uint64_t new_head;
+        do {
+            uint64_t const next = old_head & FREE_INDEX_MASK;
+            std::memcpy(link, &next, sizeof(next));
+            new_head = ((old_head & ~FREE_INDEX_MASK) + (FREE_INDEX_MASK + 1)) | (obj_index + 1);
+        } while(!head.compare_exchange_weak(old_head, new_head, std::memory_order_release,
+                                            std::memory_order_relaxed));
+        }
+    bool pop_free(size_t& out_index)
+        {
+        auto& head = m_shared_mem->hdr.free_head;
+        uint64_t old_head = head.load(std::memory_order_acquire);
+        uint64_t new_head;
+        do {
+            if(!(old_head & FREE_INDEX_MASK))
+                return false;
+            uint64_t next;
+            std::memcpy(&next, &m_shared_mem->records[(old_head & FREE_INDEX_MASK) - 1].payload,
+                        sizeof(next));
+            new_head = ((old_head & ~FREE_INDEX_MASK) + (FREE_INDEX_MASK + 1)) | next;
+        } while(!head.compare_exchange_weak(old_head, new_head, std::memory_order_acquire,
+                                            std::memory_order_acquire));
+        out_index = (old_head & FREE_INDEX_MASK) - 1;
+        std::memset((void*)&m_shared_mem->records[out_index].payload, 0, sizeof(uint64_t));
+        return true;
+        }
+
+    // try_copy() of one record, shared with mappings of only part of the file
+    static bool copy_record(Record const& rec, std::atomic<uint64_t> const& epoch_counter,
+                            T_Object& out, T_Version* out_ver)
+        {
+        uint64_t const epoch = lap_epoch(epoch_counter);
+        auto const ver = rec.cons_begin();
+        if(INVALID_VERSION == ver || (ver & Record::TOMBSTONE))
+            return false;
+        std::memcpy(&out, &rec.payload, sizeof(T_Object)); // incl. padding, for the CRC
+        uint32_t const crc = rec.stored_crc();
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if(rec.cons_commit() != ver || lap_epoch(epoch_counter) != epoch)
+            return false;
+        if(CHECKSUMMED && crc != Record::payload_crc(ver, out))
+            throw ChecksumMismatch();
+        if(out_ver)
+            *out_ver = ver;
+        return true;
+        }
+
+    static void msync_range(void const* begin, void const* end)
+        {
+        static size_t const page = ::sysconf(_SC_PAGESIZE);
+        auto const first = uintptr_t(begin) & ~(page - 1);
+        if(uintptr_t(end) > first && ::msync((void*)first, uintptr_t(end) - first, MS_SYNC))
+            throw std::system_error(errno, std::generic_category(), "msync");
+        }
+
+    static ShmRecordLayout describe(MemLayout const& mem)
+        {
+        auto const at = [&mem](void const* field)
+            {return uint32_t(static_cast<char const*>(field) - reinterpret_cast<char const*>(&mem));};
+        Record const& rec = mem.records[0];
+        uint32_t const rec0 = at(&rec);
+        ShmRecordLayout out {};
+        out.magic              = ShmRecordLayout::MAGIC;
+        out.layout_version     = ShmRecordLayout::VERSION;
+        out.header_size        = rec0;
+        out.record_stride      = sizeof(Record);
+        out.payload_offset     = at(&rec.payload) - rec0;
+        out.payload_size       = sizeof(T_Object);
+        out.version_a_offset   = at(&rec.version_a) - rec0;
+        out.version_b_offset   = at(&rec.version_b) - rec0;
+        out.version_size       = sizeof(T_Version);
+        if constexpr(A_Checksum)
+            {
+            out.crc_offset     = at(&rec.crc) - rec0;
+            out.flags         |= ShmRecordLayout::CHECKSUMMED;
+            }
+        out.size_offset        = at(&mem.hdr.size);
+        out.capacity_offset    = at(&mem.hdr.capacity);
+        out.user_header_offset = at(&mem.hdr.user_header);
+        out.user_header_size   = std::is_empty<T_UsrHeader>::value ? 0 : sizeof(T_UsrHeader);
+        out.history_depth      = uint16_t(A_History);
+        out.epoch_offset       = at(&mem.hdr.version_epoch);
+        return out;
+        }
+
 private:
     std::shared_ptr<MemLayout>  m_shared_mem; // mmap() & munmap()
+    RecoveryReport              m_recovery {};
+    std::string                 m_file_path;
 };
 
+inline std::string current_boot_id()
+{
+    char buf[40] {};
+    int const fd = ::open("/proc/sys/kernel/random/boot_id", O_RDONLY);
+    if(fd >= 0)
+        {
+        ssize_t n = ::read(fd, buf, sizeof(buf) - 1);
+        ::close(fd);
+        while(n > 0 && '\n' == buf[n - 1])
+            buf[--n] = 0;
+        }
+    return std::string(buf, strnlen(buf, sizeof(buf)));
+}
+
+//==============================================================================
+template< typename T_Object, typename T_Version, typename UsrHdr, size_t Align, bool Crc, size_t Hist, bool Dirty>
+ShmContainerBase<T_Object, T_Version, UsrHdr, Align, Crc, Hist, Dirty>::
+ShmContainerBase(size_t capacity_num_records, std::string file_path, eRole role)
+{
+    bool const producer = eRole::PRODUCER == role;
+    bool const clone    = eRole::PRIVATE_CLONE == role;
+    size_t const bytes = sizeof(MemLayout) + capacity_num_records * sizeof(Record);
+    int const fd = ::open(file_path.c_str(), (clone ? O_RDONLY : O_RDWR) | (producer ? O_CREAT : 0), 0644);
+    if(fd < 0)
+        throw std::system_error(errno, std::generic_category(), file_path);
+    struct stat st {};
+    ::fstat(fd, &st);
+    if(producer && size_t(st.st_size) < bytes && ::ftruncate(fd, bytes))
+        {
+        ::close(fd);
+        throw std::system_error(errno, std::generic_category(), "ftruncate " + file_path);
+        }
+    if(clone && size_t(st.st_size) < bytes)
+        {
+        ::close(fd);
+        throw std::invalid_argument(file_path + " is shorter than the capacity to clone");
+        }
+    // Reserve only: pages are allocated when touched
+    void* const mem = ::mmap(nullptr, bytes, PROT_READ | PROT_WRITE,
+                             (clone ? MAP_PRIVATE : MAP_SHARED) | MAP_NORESERVE, fd, 0);
+    ::close(fd);
+    if(MAP_FAILED == mem)
+        throw std::system_error(errno, std::generic_category(), "mmap " + file_path);
+
+    auto* const layout = static_cast<MemLayout*>(mem);
+    m_file_path = file_path;
+    if(clone) // detached: nothing done through it reaches the file or its users
+        {
+        m_shared_mem = std::shared_ptr<MemLayout>(layout, [bytes](MemLayout* p) {::munmap(p, bytes);});
+        return;
+        }
+    layout->hdr.refcount.fetch_add(1);
+    m_shared_mem = std::shared_ptr<MemLayout>(layout, [bytes, producer, file_path](MemLayout* p)
+        {
+        if(producer)
+            p->hdr.has_producer.store(false);
+        bool const unlink_file = 1 == p->hdr.refcount.fetch_sub(1)
+                              && p->hdr.delete_file_after_last_ref;
+        ::munmap(p, bytes);
+        if(unlink_file)
+            ::unlink(file_path.c_str());
+        });
+    ShmRecordLayout const expected = describe(*layout);
+    if(!producer && ShmRecordLayout::MAGIC == layout->hdr.layout.magic
+       && std::memcmp(&expected, &layout->hdr.layout, sizeof(expected)))
+        {
+        m_shared_mem.reset();
+        throw std::invalid_argument(file_path + ": record layout differs from this consumer's");
+        }
+    if(producer)
+        {
+        layout->hdr.layout = expected;
+        if(0 == st.st_size)
+            layout->hdr.capacity.store(capacity_num_records, std::memory_order_relaxed);
+        else
+            m_recovery = recover(false);
+        std::string const boot = current_boot_id();
+        std::memcpy(layout->hdr.boot_id, boot.c_str(), std::min(boot.size(), sizeof(Header::boot_id) - 1));
+        layout->hdr.has_producer.store(true);
+        }
+}
+
+//==============================================================================
+template< typename T_Object, typename T_Version, typename UsrHdr, size_t Align, bool Crc, size_t Hist, bool Dirty>
+void ShmContainerBase<T_Object, T_Version, UsrHdr, Align, Crc, Hist, Dirty>::
+clone_reflink(std::string const& clone_path) const
+{
+    int const src = ::open(m_file_path.c_str(), O_RDONLY);
+    if(src < 0)
+        throw std::system_error(errno, std::generic_category(), m_file_path);
+    int const dst = ::open(clone_path.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644);
+    if(dst < 0)
+        {
+        int const err = errno;
+        ::close(src);
+        throw std::system_error(err, std::generic_category(), clone_path);
+        }
+    int const rc = ::ioctl(dst, FICLONE, src);
+    int const err = errno;
+    ::close(src);
+    void* const mem = rc ? MAP_FAILED : ::mmap(nullptr, sizeof(Header), PROT_READ | PROT_WRITE, MAP_SHARED, dst, 0);
+    ::close(dst);
+    if(rc)
+        {
+        ::unlink(clone_path.c_str());
+        throw std::system_error(err, std::generic_category(), "FICLONE " + clone_path);
+        }
+    if(MAP_FAILED == mem)
+        throw std::system_error(errno, std::generic_category(), "mmap " + clone_path);
+    // The clone starts out unattached
+    auto* const hdr = static_cast<Header*>(mem);
+    hdr->refcount.store(0);
+    hdr->has_producer.store(false);
+    ::munmap(mem, sizeof(Header));
+}
+
+//==============================================================================
+template< typename T_Object, typename T_Version, typename UsrHdr, size_t Align, bool Crc, size_t Hist, bool Dirty>
+auto ShmContainerBase<T_Object, T_Version, UsrHdr, Align, Crc, Hist, Dirty>::
+recover(bool full_scan) -> RecoveryReport
+{
+    auto& hdr = m_shared_mem->hdr;
+    RecoveryReport report;
+    report.after_reboot = hdr.boot_id[0] && current_boot_id() != hdr.boot_id;
+    size_t const durable = std::min(hdr.durable_size.load(), hdr.size.load());
+    size_t const old_size = hdr.size.load();
+    auto const intact = [](Record const& rec)
+        {
+        T_Version const ver = rec.cons_commit();
+        if(rec.cons_begin() != ver)
+            return false;
+        return !CHECKSUMMED || INVALID_VERSION == ver
+            || rec.stored_crc() == Record::payload_crc(ver, rec.payload);
+        };
+
+    // The tail: keep committed records up to the first one that is not
+    size_t new_size = durable;
+    if(!report.after_reboot)
+        while(new_size < old_size
+              && INVALID_VERSION != m_shared_mem->records[new_size].cons_begin()
+              && intact(m_shared_mem->records[new_size]))
+            ++new_size;
+    report.dropped_tail = old_size - new_size;
+
+    // Torn in-place updates: only the last one before a live crash, but
+    // any of them after a reboot.
+    size_t const scan_from = full_scan || report.after_reboot ? 0 : durable;
+    for(size_t idx = scan_from; idx < new_size; ++idx)
+        {
+        Record& rec = m_shared_mem->records[idx];
+        if(intact(rec))
+            continue;
+        rec.payload = T_Object{};
+        rec.version_b.store(INVALID_VERSION);
+        rec.version_a.store(INVALID_VERSION);
+        ++report.dropped_torn;
+        }
+    hdr.size.store(new_size, std::memory_order_release);
+    hdr.durable_size.store(std::min(durable, new_size), std::memory_order_release);
+    report.kept = new_size;
+    return report;
+}
+
+//==============================================================================
+template< typename T_Object, typename T_Version, typename UsrHdr, size_t Align, bool Crc, size_t Hist, bool Dirty>
+template<typename F>
+size_t ShmContainerBase<T_Object, T_Version, UsrHdr, Align, Crc, Hist, Dirty>::
+scan(size_t first, size_t last, F&& on_record, ScanConfig const& cfg) const
+{
+    static size_t const page = ::sysconf(_SC_PAGESIZE);
+    last = std::min(last, size());
+    if(first >= last)
+        return 0;
+    auto const* const records = m_shared_mem->records;
+    auto const file_base = uintptr_t(m_shared_mem.get());
+    uintptr_t const begin = uintptr_t(&records[first]) & ~(page - 1);
+    uintptr_t const end   = (uintptr_t(&records[last]) + page - 1) & ~(page - 1);
+    size_t const step     = std::max(page, cfg.step_bytes & ~(page - 1));
+    ::madvise((void*)begin, end - begin, MADV_SEQUENTIAL);
+    int const fd = cfg.drop_behind ? ::open(m_file_path.c_str(), O_RDONLY) : -1;
+    auto const drop = [&](uintptr_t from, uintptr_t to)
+        {
+        ::madvise((void*)from, to - from, MADV_DONTNEED); // shared mapping: the file keeps the data
+        if(fd >= 0)
+            ::posix_fadvise(fd, off_t(from - file_base), off_t(to - from), POSIX_FADV_DONTNEED);
+        };
+
+    uintptr_t advised = begin; // WILLNEED issued below this
+    uintptr_t dropped = begin; // released below this
+    T_Object obj;
+    size_t idx = first;
+    for(; idx < last; ++idx)
+        {
+        auto const at = uintptr_t(&records[idx]);
+        if(advised < end && at + cfg.readahead_bytes >= advised)
+            {
+            uintptr_t const to = std::min(end, std::max(advised + step, (at + cfg.readahead_bytes) & ~(page - 1)));
+            ::madvise((void*)advised, to - advised, MADV_WILLNEED);
+            advised = to;
+            }
+        if(cfg.drop_behind && at >= dropped + 2 * step)
+            {
+            uintptr_t const to = (at & ~(page - 1)) - step; // a step of slack behind the cursor
+            drop(dropped, to);
+            dropped = to;
+            }
+        if(try_copy(idx, obj) || try_copy(idx, obj))
+            on_record(idx, obj);
+        else if(!is_erased(idx))
+            break; // being written: history ends here for now
+        }
+    if(cfg.drop_behind)
+        drop(dropped, end);
+    ::madvise((void*)begin, end - begin, MADV_NORMAL);
+    if(fd >= 0)
+        ::close(fd);
+    return idx - first;
+}
+
+//==============================================================================
+template< typename T_Object, typename T_Version, typename UsrHdr, size_t Align, bool Crc, size_t Hist, bool Dirty>
+template<typename T_FwdLog>
+size_t ShmContainerBase<T_Object, T_Version, UsrHdr, Align, Crc, Hist, Dirty>::
+compact(T_FwdLog& fwd_log, size_t max_moves)
+{
+    auto& hdr = m_shared_mem->hdr;
+    auto* const records = m_shared_mem->records;
+    std::vector<size_t> holes;
+    for(size_t idx; pop_free(idx); )
+        holes.push_back(idx);
+    std::sort(holes.begin(), holes.end());
+
+    size_t const old_size = size();
+    size_t top = old_size;
+    auto const drop_dead_tail = [&] {while(top && records[top - 1].erased()) --top;};
+    drop_dead_tail();
+    uint64_t const gen = hdr.compaction_gen.load(std::memory_order_relaxed) + 1;
+    size_t moves = 0, next_hole = 0;
+    for(; moves < max_moves && next_hole < holes.size() && holes[next_hole] + 1 < top; ++moves)
+        {
+        size_t const from = top - 1, to = holes[next_hole++];
+        records[to].prod_revive();
+        {
+            auto prod = produce_begin(to);
+            std::memcpy((void*)prod.get(), &records[from].payload, sizeof(T_Object));
+        }
+        *fwd_log.emplace_back() = ForwardEntry{from, to, gen};
+        records[from].prod_erase(hdr.version_epoch);
+        --top;
+        drop_dead_tail();
+        }
+    for(; next_hole < holes.size(); ++next_hole)
+        if(holes[next_hole] < top)
+            push_free(holes[next_hole]);
+    if(top == old_size)
+        return moves;
+
+    // Retire [top, old_size): whole pages go back to the OS, the rest is reset
+    hdr.size.store(top, std::memory_order_release);
+    hdr.compaction_gen.store(gen, std::memory_order_release);
+    static size_t const page = ::sysconf(_SC_PAGESIZE);
+    auto const page_begin = (uintptr_t(&records[top]) + page - 1) & ~(page - 1);
+    auto const page_end   = uintptr_t(&records[old_size]) & ~(page - 1);
+    bool const released = page_end > page_begin
+        && 0 == ::madvise((void*)page_begin, page_end - page_begin, MADV_REMOVE);
+    for(size_t idx = top; idx < old_size; ++idx)
+        {
+        auto const addr = uintptr_t(&records[idx]);
+        if(released && addr >= page_begin && addr + sizeof(Record) <= page_end)
+            continue;
+        std::memset((void*)&records[idx].payload, 0, sizeof(T_Object));
+        records[idx].version_b.store(INVALID_VERSION);
+        records[idx].version_a.store(INVALID_VERSION, std::memory_order_release);
+        }
+    return moves;
+}
+
 //==============================================================================
-template< typename T_Object, typename T_Version, typename UsrHdr, size_t Align>
-class ShmContainerBase<T_Object, T_Version, UsrHdr, Align>::
+template< typename T_Object, typename T_Version, typename UsrHdr, size_t Align, bool Crc, size_t Hist, bool Dirty>
+class ShmContainerBase<T_Object, T_Version, UsrHdr, Align, Crc, Hist, Dirty>::
 ScopedConsume
 {
     Record*           m_rec {};
     T_Version mutable m_pre_consume_ver {INVALID_VERSION};
+    std::atomic<uint64_t> const* m_epoch {};
+    uint64_t mutable  m_pre_consume_epoch {};
 public:
-    explicit ScopedConsume(Record* p = nullptr) : m_rec(p) {}
+    explicit ScopedConsume(Record* p = nullptr, std::atomic<uint64_t> const* epoch = nullptr)
+        : m_rec(p), m_epoch(epoch)
+        {}
     ~ScopedConsume() {if(m_rec) throw VersionUnchecked();} // User forgot check
     bool try_consume_commit()
         {
         assert(m_rec);
+        std::atomic_thread_fence(std::memory_order_acquire); // payload reads stay above
         auto const curr_ver = m_rec->cons_commit();
-        if(LIKELY(curr_ver == m_pre_consume_ver))
+        uint64_t const curr_epoch = epoch();
+        if(LIKELY(curr_ver == m_pre_consume_ver && curr_epoch == m_pre_consume_epoch))
             {
             cancel_consume(); // prevent exception
             return true;
             }
-        m_pre_consume_ver = curr_ver;
+        // version_b may belong to a write still in progress: the retry's
+        // get() must start over from version_a
+        m_pre_consume_ver = INVALID_VERSION;
         return false; // user shall now retry consume the object
         }
-    T_Object const* get() const __attribute__((const))
+    T_Object const* get() const
         {
         assert(m_rec);
         // The first get() call marks beginning of consumption. Remember version
         if(INVALID_VERSION == m_pre_consume_ver)
-            m_pre_consume_ver = m_rec->cons_begin();
+            {
+            m_pre_consume_epoch = epoch();
+            m_pre_consume_ver   = m_rec->cons_begin();
+            }
         return &m_rec->payload;
         }
     T_Object get_copy()
         {
         T_Object res;
-        do { res = *get(); } while(!this->try_consume_commit());
+        Record const* const rec = m_rec;
+        T_Version ver;
+        uint32_t crc;
+        do {
+            std::memcpy(&res, get(), sizeof(T_Object));
+            ver = m_pre_consume_ver;
+            crc = rec->stored_crc();
+        } while(!this->try_consume_commit());
+        if(CHECKSUMMED && INVALID_VERSION != ver && crc != Record::payload_crc(ver, res))
+            throw ChecksumMismatch();
         return res;
         }
     explicit operator bool() const {return !!m_rec;}
@@ -157,39 +1016,72 @@ public:
 private:
     void adv() {assert(m_rec); ++m_rec;}
     void cancel_consume() {m_rec = nullptr;}
+    uint64_t epoch() const
+        {
+        if constexpr(LAPS_POSSIBLE)
+            return m_epoch ? m_epoch->load(std::memory_order_acquire) : 0;
+        return 0;
+        }
 };
 
 //==============================================================================
-template< typename T_Object, typename T_Version, typename UsrHdr, size_t Align>
-class ShmContainerBase<T_Object, T_Version, UsrHdr, Align>::
+template< typename T_Object, typename T_Version, typename UsrHdr, size_t Align, bool Crc, size_t Hist, bool Dirty>
+class ShmContainerBase<T_Object, T_Version, UsrHdr, Align, Crc, Hist, Dirty>::
 ScopedProduce
 {
     Record*     m_rec {};
     T_Version   m_initial_ver {INVALID_VERSION};
+    uint64_t    m_dirty {};
+    std::atomic<uint64_t>* m_epoch {};
 public:
-    explicit ScopedProduce(Record* p = nullptr) : m_rec(p) {}
+    explicit ScopedProduce(Record* p = nullptr, std::atomic<uint64_t>* epoch = nullptr)
+        : m_rec(p), m_epoch(epoch)
+        {}
     ~ScopedProduce()       {if(m_rec) produce_commit(); } // auto-commit, can't fail
     T_Object* operator->() {return get();}
     T_Object& operator*()  {return *get();}
-    T_Object* get() __attribute__((const))
+    // Untracked access: the version is published with all fields dirty
+    T_Object* get()
         {
-        assert(m_rec);
-        if(INVALID_VERSION == m_initial_ver)
-            m_initial_ver = m_rec->prod_begin();
-        return &m_rec->payload;
+        m_dirty = ALL_FIELDS;
+        return begin();
+        }
+    // Field-aware write, marks the field dirty only if its bits change:
+    //   vptr.set<&NseTicker::bid_px>(39000);
+    template<auto A_Member>
+    void set(typename MemberOf<decltype(A_Member)>::type const& value)
+        {
+        static_assert(std::is_same<typename MemberOf<decltype(A_Member)>::object, T_Object>::value,
+                      "not a member of T_Object");
+        auto& field = begin()->*A_Member;
+        if(std::memcmp(&field, &value, sizeof(value)))
+            {
+            field = value;
+            m_dirty |= field_bit<A_Member>();
+            }
         }
     void produce_commit(bool const a_used_memcpy_or_movnti = true)
         {
         if(a_used_memcpy_or_movnti)
             _mm_sfence();
+        if constexpr(Dirty)
+            m_rec->dirty = m_dirty;
         m_rec->prod_commit(m_initial_ver);
         m_rec = nullptr;
         }
+private:
+    T_Object* begin()
+        {
+        assert(m_rec);
+        if(INVALID_VERSION == m_initial_ver)
+            m_initial_ver = m_rec->prod_begin(*m_epoch);
+        return &m_rec->payload;
+        }
 };
 
 //==============================================================================
-template< typename T_Object, typename Ver, typename UsrHdr, size_t Align>
-class ShmContainerBase<T_Object, Ver, UsrHdr, Align>::iterator
+template< typename T_Object, typename Ver, typename UsrHdr, size_t Align, bool Crc, size_t Hist, bool Dirty>
+class ShmContainerBase<T_Object, Ver, UsrHdr, Align, Crc, Hist, Dirty>::iterator
 {
     ScopedConsume m_rec_ptr {};
 public:
@@ -219,16 +1111,41 @@ template< typename T_Object
         , typename T_Version    = uint32_t
         , typename T_UsrHeader  = NoHeaderInfo // optional
         , size_t   A_Alignment  = std::alignment_of<T_Object>::value
+        , bool     A_Checksum   = false
+        , size_t   A_History    = 0
+        , bool     A_DirtyMask  = false
         >
 struct ShmContainerProducer
-    : private ShmContainerBase<T_Object, T_Version, T_UsrHeader, A_Alignment>
+    : private ShmContainerBase<T_Object, T_Version, T_UsrHeader, A_Alignment, A_Checksum, A_History, A_DirtyMask>
 {
-    using Base = ShmContainerBase<T_Object, T_Version, T_UsrHeader, A_Alignment>;
+    using Base = ShmContainerBase<T_Object, T_Version, T_UsrHeader, A_Alignment, A_Checksum, A_History, A_DirtyMask>;
+    using typename Base::value_type;
+    using typename Base::version_type;
+    using Base::CHECKSUMMED;
     using Base::produce_begin;
     using Base::emplace_back;
+    using Base::erase;
+    using Base::emplace;
+    using Base::is_erased;
+    using Base::compact;
+    using Base::compaction_gen;
+    using Base::sync_durable;
+    using Base::durable_size;
+    using Base::recover;
+    using Base::last_recovery;
+    using typename Base::RecoveryReport;
+    using Base::size;
+    using Base::capacity;
+    using Base::user_header;
+    using Base::record_layout;
+    using Base::clone_reflink;
     ShmContainerProducer(size_t capacity_num_records, std::string file_path)
         : Base(capacity_num_records, file_path, Base::eRole::PRODUCER)
         {}
+    explicit ShmContainerProducer(Base&& detached) // see clone_private()
+        : Base(std::move(detached))
+        {}
+    ShmContainerProducer clone_private() const {return ShmContainerProducer(Base::clone_private());}
 };
 
 //==============================================================================
@@ -236,57 +1153,4898 @@ template< typename T_Object
         , typename T_Version    = uint32_t
         , typename T_UsrHeader  = NoHeaderInfo // optional
         , size_t   A_Alignment  = std::alignment_of<T_Object>::value
+        , bool     A_Checksum   = false
+        , size_t   A_History    = 0
+        , bool     A_DirtyMask  = false
         >
 struct ShmContainerConsumer
-    : private ShmContainerBase<T_Object, T_Version, T_UsrHeader, A_Alignment>
+    : private ShmContainerBase<T_Object, T_Version, T_UsrHeader, A_Alignment, A_Checksum, A_History, A_DirtyMask>
 {
-    using Base = ShmContainerBase<T_Object, T_Version, T_UsrHeader, A_Alignment>;
+    using Base = ShmContainerBase<T_Object, T_Version, T_UsrHeader, A_Alignment, A_Checksum, A_History, A_DirtyMask>;
+    using typename Base::value_type;
+    using typename Base::version_type;
+    using Base::CHECKSUMMED;
     using Base::consume_begin;
+    using Base::try_copy;
+    using Base::try_copy_changes;
+    using Base::copy_committed;
+    using Base::scan;
+    using Base::try_project;
+    using Base::prefetch;
+    using Base::version;
+    using Base::check_record;
+    using Base::is_erased;
+    using Base::compaction_gen;
+    using Base::try_copy_version;
+    using Base::copy_history;
+    using typename Base::eCheck;
+    using typename Base::ChecksumMismatch;
+    using Base::size;
+    using Base::capacity;
+    using Base::user_header;
+    using Base::record_layout;
+    using Base::clone_reflink;
     ShmContainerConsumer(size_t capacity_num_records, std::string file_path)
         : Base(capacity_num_records, file_path, Base::eRole::CONSUMER)
         {}
+    // The what-if copy is written to, so it comes with the producer API
+    ShmContainerProducer<T_Object, T_Version, T_UsrHeader, A_Alignment, A_Checksum, A_History, A_DirtyMask>
+    clone_private() const
+        {
+        return ShmContainerProducer<T_Object, T_Version, T_UsrHeader, A_Alignment, A_Checksum, A_History, A_DirtyMask>(
+            Base::clone_private());
+        }
 };
 
 //==============================================================================
-
-// Example contained object
-struct NseTicker
+// Consumer that maps a window of the file instead of its whole capacity:
+// the header, plus an LRU of chunks of consecutive records. Touching a
+// record outside the window maps its chunk over the least recently used
+// one (MAP_FIXED into a reservation taken at attach), so the address space
+// and page tables stay the size of the window however large the container
+// is. A tailing reader keeps the tail chunk hot; random readers pay an
+// mmap per miss. Translation is a shift and a compare with the last chunk
+// hit, a scan of the window otherwise. Not thread-safe, and a ScopedConsume
+// from consume_begin() is valid until the next call that moves the window.
+struct WindowConfig
 {
-    uint32_t ask_px;
-    uint32_t ask_qx;
-    uint32_t bid_px;
-    uint32_t bid_qx;
+    size_t chunk_bytes   = 2 << 20; // rounded down to a power of two records
+    size_t window_chunks = 16;
 };
 
-void example_producer()
+template< typename T_Object
+        , typename T_Version    = uint32_t
+        , typename T_UsrHeader  = NoHeaderInfo // optional
+        , size_t   A_Alignment  = std::alignment_of<T_Object>::value
+        , bool     A_Checksum   = false
+        , size_t   A_History    = 0
+        , bool     A_DirtyMask  = false
+        >
+class ShmWindowedConsumer
 {
-    ShmContainerProducer<NseTicker> shm_container(1000, "/tmp/nse_tickers.shm");
+    using Base      = ShmContainerBase<T_Object, T_Version, T_UsrHeader, A_Alignment, A_Checksum, A_History, A_DirtyMask>;
+    using Record    = typename Base::Record;
+    using MemLayout = typename Base::MemLayout;
+public:
+    using value_type    = T_Object;
+    using version_type  = T_Version;
+    using ScopedConsume = typename Base::ScopedConsume;
+    using ChecksumMismatch = typename Base::ChecksumMismatch;
+    static constexpr bool CHECKSUMMED = A_Checksum;
 
-    // Get a "versioned pointer"
-    auto vptr = shm_container.emplace_back();
+    ShmWindowedConsumer(size_t capacity_num_records, std::string file_path, WindowConfig cfg = {})
+        : m_capacity(capacity_num_records), m_file_path(std::move(file_path))
+        {
+        m_fd = ::open(m_file_path.c_str(), O_RDWR);
+        if(m_fd < 0)
+            throw std::system_error(errno, std::generic_category(), m_file_path);
+        struct stat st {};
+        ::fstat(m_fd, &st);
+        if(size_t(st.st_size) < sizeof(MemLayout) + m_capacity * sizeof(Record))
+            {
+            ::close(m_fd);
+            throw std::invalid_argument(m_file_path + " is shorter than the capacity");
+            }
+        m_header_bytes = round_to_page(sizeof(MemLayout));
+        void* const hdr = ::mmap(nullptr, m_header_bytes, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+        if(MAP_FAILED == hdr)
+            {
+            int const err = errno;
+            ::close(m_fd);
+            throw std::system_error(err, std::generic_category(), "mmap " + m_file_path);
+            }
+        m_mem = static_cast<MemLayout*>(hdr);
+        ShmRecordLayout const expected = Base::describe(*m_mem);
+        if(ShmRecordLayout::MAGIC == m_mem->hdr.layout.magic
+           && std::memcmp(&expected, &m_mem->hdr.layout, sizeof(expected)))
+            {
+            ::munmap(hdr, m_header_bytes);
+            ::close(m_fd);
+            throw std::invalid_argument(m_file_path + ": record layout differs from this consumer's");
+            }
+        m_records_offset = expected.header_size;
 
-    // Update the object in any way you want (not atomically),
-    // but be quick because consumers will keep retrying their read
-    // until vptr gets out of scope or vptr.produce_commit() is called.
-    vptr->bid_px = 39000;
-    vptr->ask_px = 41000;
-    vptr->bid_qx = 55;
-    vptr->ask_qx = 77;
+        size_t per_chunk = 1;
+        while(per_chunk * 2 * sizeof(Record) <= cfg.chunk_bytes)
+            per_chunk *= 2;
+        m_chunk_shift = size_t(__builtin_ctzll(per_chunk));
+        m_slot_bytes  = round_to_page(per_chunk * sizeof(Record)) + page_size(); // chunks start mid-page
+        m_slots.resize(std::max<size_t>(1, cfg.window_chunks));
+        void* const window = ::mmap(nullptr, m_slots.size() * m_slot_bytes, PROT_NONE,
+                                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if(MAP_FAILED == window)
+            {
+            int const err = errno;
+            ::munmap(hdr, m_header_bytes);
+            ::close(m_fd);
+            throw std::system_error(err, std::generic_category(), "mmap window");
+            }
+        m_window = static_cast<char*>(window);
+        m_mem->hdr.refcount.fetch_add(1);
+        }
+    ~ShmWindowedConsumer()
+        {
+        bool const unlink_file = 1 == m_mem->hdr.refcount.fetch_sub(1)
+                              && m_mem->hdr.delete_file_after_last_ref;
+        ::munmap(m_window, m_slots.size() * m_slot_bytes);
+        ::munmap(m_mem, m_header_bytes);
+        ::close(m_fd);
+        if(unlink_file)
+            ::unlink(m_file_path.c_str());
+        }
+    ShmWindowedConsumer(ShmWindowedConsumer const&) = delete;
+    ShmWindowedConsumer& operator=(ShmWindowedConsumer const&) = delete;
 
-    // optional. Will automatically be called when vptr gets out of scope anyway
-    vptr.produce_commit();
+    ScopedConsume consume_begin(size_t obj_index)
+        {return ScopedConsume(record(obj_index), &m_mem->hdr.version_epoch);}
+    bool try_copy(size_t obj_index, T_Object& out, T_Version* out_ver = nullptr)
+        {return Base::copy_record(*record(obj_index), m_mem->hdr.version_epoch, out, out_ver);}
 
-    // Now consumers will see the updated version only
-}
+    size_t size() const     {return m_mem->hdr.size.load(std::memory_order_acquire);}
+    size_t capacity() const {return m_capacity;}
+    T_UsrHeader& user_header() {return m_mem->hdr.user_header;}
+    ShmRecordLayout const& record_layout() const {return m_mem->hdr.layout;}
 
-void example_consumer()
-{
-    // Consumers "connect" to the shared memory by passing in the file path.
-    ShmContainerConsumer<NseTicker> shm_container(1000, "/tmp/nse_tickers.shm");
+    size_t   chunk_records() const {return size_t(1) << m_chunk_shift;}
+    size_t   window_bytes() const  {return m_slots.size() * m_slot_bytes;}
+    uint64_t remaps() const        {return m_remaps;}
 
-    // The "versioned pointer" makes sure you can only do consistent reads.
-    // Here we are beginning a read of object [0] in the container.
-    auto vptr = shm_container.consume_begin(0);
-    NseTicker const ticker = vptr.get_copy();
+private:
+    static constexpr size_t NO_CHUNK = ~size_t(0);
+    struct Slot
+    {
+        size_t   chunk {NO_CHUNK};
+        Record*  first {};     // record chunk << m_chunk_shift
+        uint64_t last_use {};
+    };
+
+    Record* record(size_t obj_index)
+        {
+        assert(obj_index < m_capacity);
+        size_t const chunk = obj_index >> m_chunk_shift;
+        if(LIKELY(chunk == m_last_chunk))
+            return m_last_first + (obj_index & (chunk_records() - 1));
+        return map_chunk(chunk) + (obj_index & (chunk_records() - 1));
+        }
+
+    Record* map_chunk(size_t chunk)
+        {
+        Slot* victim = &m_slots[0];
+        for(Slot& slot : m_slots)
+            {
+            if(slot.chunk == chunk)
+                {
+                victim = &slot;
+                break;
+                }
+            if(slot.last_use < victim->last_use)
+                victim = &slot;
+            }
+        if(victim->chunk != chunk)
+            {
+            size_t const first = chunk << m_chunk_shift;
+            size_t const count = std::min(chunk_records(), m_capacity - first);
+            size_t const offset = m_records_offset + first * sizeof(Record);
+            size_t const map_offset = offset & ~(page_size() - 1);
+            size_t const bytes = round_to_page(offset - map_offset + count * sizeof(Record));
+            char* const at = m_window + (victim - m_slots.data()) * m_slot_bytes;
+            if(MAP_FAILED == ::mmap(at, bytes, PROT_READ, MAP_SHARED | MAP_FIXED, m_fd, off_t(map_offset)))
+                throw std::system_error(errno, std::generic_category(), "mmap " + m_file_path);
+            victim->chunk = chunk;
+            victim->first = reinterpret_cast<Record*>(at + (offset - map_offset));
+            ++m_remaps;
+            }
+        victim->last_use = ++m_clock;
+        m_last_chunk = chunk;
+        m_last_first = victim->first;
+        return victim->first;
+        }
+
+    static size_t page_size()
+        {
+        static size_t const page = ::sysconf(_SC_PAGESIZE);
+        return page;
+        }
+    static size_t round_to_page(size_t bytes) {return (bytes + page_size() - 1) & ~(page_size() - 1);}
+
+    size_t            m_capacity {};
+    std::string       m_file_path;
+    int               m_fd {-1};
+    MemLayout*        m_mem {};
+    size_t            m_header_bytes {};
+    size_t            m_records_offset {};
+    size_t            m_chunk_shift {};
+    size_t            m_slot_bytes {};
+    char*             m_window {};
+    std::vector<Slot> m_slots;
+    size_t            m_last_chunk {NO_CHUNK};
+    Record*           m_last_first {};
+    uint64_t          m_clock {};
+    uint64_t          m_remaps {};
+};
+
+//==============================================================================
+// TCP replication of a container to a remote mirror.
+// ShmReplicationSender tails a consumer attached to the producer's file and
+// streams committed records in length-prefixed batches. ShmReplicationReceiver
+// applies them at the same indices into its own producer, so the mirror ends
+// up with an identical container. Only appended records are tailed; in-place
+// updates below the tail are re-sent only when the mirror asks for a resync.
+struct ReplicationConfig
+{
+    size_t   max_batch_records  = 1024;  // records per frame
+    uint32_t max_batch_delay_us = 50;    // linger to fill a partial batch
+    bool     tcp_nodelay        = true;  // disable Nagle, we batch ourselves
+    int      socket_buf_bytes   = 4 << 20;
+};
+
+struct ReplicationStats
+{
+    uint64_t records {};
+    uint64_t batches {};
+    uint64_t bytes {};
+    uint64_t gaps {};         // receiver: frames that skipped ahead of us
+    uint64_t resyncs {};      // sender: resync requests served
+    std::vector<uint32_t> latency_ns; // receiver: send -> applied, per batch
+};
+
+// Wire format, native endianness: both ends run the same binary layout.
+struct ReplFrameHdr
+{
+    uint32_t bytes;        // payload bytes following this header
+    uint32_t num_records;
+    uint64_t first_index;
+    uint64_t send_ns;      // sender steady_clock, same-host latency only
+};
+struct ReplResyncReq
+{
+    uint64_t from_index;
+};
+
+class ShmSocket
+{
+    int m_fd {-1};
+public:
+    explicit ShmSocket(int fd = -1) : m_fd(fd) {}
+    ShmSocket(ShmSocket&& rhs) : m_fd(rhs.m_fd) {rhs.m_fd = -1;}
+    ShmSocket& operator=(ShmSocket&& rhs) {std::swap(m_fd, rhs.m_fd); return *this;}
+    ~ShmSocket() {if(m_fd >= 0) ::close(m_fd);}
+    int fd() const {return m_fd;}
+    explicit operator bool() const {return m_fd >= 0;}
+
+    static ShmSocket listen_tcp(char const* ip, uint16_t port)
+        {
+        ShmSocket s(::socket(AF_INET, SOCK_STREAM, 0));
+        int one = 1;
+        ::setsockopt(s.fd(), SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        sockaddr_in addr = make_addr(ip, port);
+        if(!s || ::bind(s.fd(), (sockaddr*)&addr, sizeof(addr)) || ::listen(s.fd(), 1))
+            throw std::system_error(errno, std::generic_category(), "listen_tcp");
+        return s;
+        }
+    static ShmSocket connect_tcp(char const* ip, uint16_t port)
+        {
+        ShmSocket s(::socket(AF_INET, SOCK_STREAM, 0));
+        sockaddr_in addr = make_addr(ip, port);
+        if(!s || ::connect(s.fd(), (sockaddr*)&addr, sizeof(addr)))
+            throw std::system_error(errno, std::generic_category(), "connect_tcp");
+        return s;
+        }
+    // Waits up to timeout_ms; returns an invalid socket on timeout.
+    ShmSocket accept(int timeout_ms) const
+        {
+        if(!wait_readable(timeout_ms))
+            return ShmSocket();
+        return ShmSocket(::accept(m_fd, nullptr, nullptr));
+        }
+    void tune(ReplicationConfig const& cfg) const
+        {
+        int const nodelay = cfg.tcp_nodelay;
+        ::setsockopt(m_fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+        ::setsockopt(m_fd, SOL_SOCKET, SO_SNDBUF, &cfg.socket_buf_bytes, sizeof(int));
+        ::setsockopt(m_fd, SOL_SOCKET, SO_RCVBUF, &cfg.socket_buf_bytes, sizeof(int));
+        }
+    bool wait_readable(int timeout_ms) const
+        {
+        pollfd pfd {m_fd, POLLIN, 0};
+        return ::poll(&pfd, 1, timeout_ms) > 0;
+        }
+    size_t readable_bytes() const
+        {
+        int n = 0;
+        ::ioctl(m_fd, FIONREAD, &n);
+        return n > 0 ? n : 0;
+        }
+    // Whole-buffer I/O. False means the peer has gone away.
+    bool send_all(void const* buf, size_t len) const
+        {
+        auto p = static_cast<char const*>(buf);
+        while(len)
+            {
+            ssize_t const n = ::send(m_fd, p, len, MSG_NOSIGNAL);
+            if(n <= 0 && errno != EINTR)
+                return false;
+            if(n > 0) {p += n; len -= n;}
+            }
+        return true;
+        }
+    bool recv_all(void* buf, size_t len) const
+        {
+        auto p = static_cast<char*>(buf);
+        while(len)
+            {
+            ssize_t const n = ::recv(m_fd, p, len, 0);
+            if(n == 0 || (n < 0 && errno != EINTR))
+                return false;
+            if(n > 0) {p += n; len -= n;}
+            }
+        return true;
+        }
+private:
+    static sockaddr_in make_addr(char const* ip, uint16_t port)
+        {
+        sockaddr_in addr {};
+        addr.sin_family = AF_INET;
+        addr.sin_port   = htons(port);
+        ::inet_pton(AF_INET, ip, &addr.sin_addr);
+        return addr;
+        }
+};
+
+inline uint64_t steady_now_ns()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+//==============================================================================
+template<typename T_Consumer> // ShmContainerConsumer<...>
+class ShmReplicationSender
+{
+public:
+    using Consumer = T_Consumer;
+    using T_Object = typename Consumer::value_type;
+
+    ShmReplicationSender(T_Consumer& source, char const* listen_ip, uint16_t port,
+                         ReplicationConfig cfg = {})
+        : m_src(source), m_cfg(cfg)
+        , m_listener(ShmSocket::listen_tcp(listen_ip, port))
+        , m_buf(sizeof(ReplFrameHdr) + cfg.max_batch_records * sizeof(T_Object))
+        {}
+
+    // Serves one mirror at a time until stop is set. A mirror that
+    // disconnects can reconnect and resume from wherever it left off.
+    void run(std::atomic<bool> const& stop)
+        {
+        while(!stop.load(std::memory_order_relaxed))
+            {
+            ShmSocket peer = m_listener.accept(100);
+            if(!peer)
+                continue;
+            peer.tune(m_cfg);
+            ReplResyncReq req;
+            if(peer.recv_all(&req, sizeof(req)))
+                serve(peer, req.from_index, stop);
+            }
+        }
+
+    ReplicationStats const& stats() const {return m_stats;}
+
+private:
+    void serve(ShmSocket const& peer, uint64_t next, std::atomic<bool> const& stop)
+        {
+        auto* const hdr     = reinterpret_cast<ReplFrameHdr*>(m_buf.data());
+        auto* const records = reinterpret_cast<T_Object*>(m_buf.data() + sizeof(ReplFrameHdr));
+        uint64_t const linger_ns = m_cfg.max_batch_delay_us * 1000ull;
+        while(!stop.load(std::memory_order_relaxed))
+            {
+            // Mirror may ask to rewind (or skip ahead) at any time
+            if(peer.readable_bytes() >= sizeof(ReplResyncReq))
+                {
+                ReplResyncReq req;
+                if(!peer.recv_all(&req, sizeof(req)))
+                    return;
+                next = req.from_index;
+                ++m_stats.resyncs;
+                }
+            // Fill a batch, lingering briefly if it is only partially full
+            size_t n = 0;
+            uint64_t const t0 = steady_now_ns();
+            do {
+                n += m_src.copy_committed(next + n, m_cfg.max_batch_records - n, records + n);
+            } while(n < m_cfg.max_batch_records && steady_now_ns() - t0 < linger_ns);
+            if(!n)
+                {
+                if(peer.wait_readable(0) && !peer.readable_bytes())
+                    return; // orderly shutdown by peer
+                std::this_thread::yield();
+                continue;
+                }
+            hdr->bytes       = n * sizeof(T_Object);
+            hdr->num_records = n;
+            hdr->first_index = next;
+            hdr->send_ns     = steady_now_ns();
+            if(!peer.send_all(m_buf.data(), sizeof(ReplFrameHdr) + hdr->bytes))
+                return;
+            next += n;
+            m_stats.records += n;
+            m_stats.batches += 1;
+            m_stats.bytes   += sizeof(ReplFrameHdr) + hdr->bytes;
+            }
+        }
+
+    Consumer&          m_src;
+    ReplicationConfig  m_cfg;
+    ShmSocket          m_listener;
+    std::vector<char>  m_buf;
+    ReplicationStats   m_stats;
+};
+
+//==============================================================================
+template<typename T_Producer> // ShmContainerProducer<...>
+class ShmReplicationReceiver
+{
+public:
+    using Producer = T_Producer;
+    using T_Object = typename Producer::value_type;
+    static constexpr size_t MAX_LATENCY_SAMPLES = 1 << 20;
+
+    ShmReplicationReceiver(T_Producer& mirror, char const* sender_ip, uint16_t port,
+                           ReplicationConfig cfg = {})
+        : m_dst(mirror)
+        , m_peer(ShmSocket::connect_tcp(sender_ip, port))
+        , m_buf(cfg.max_batch_records * sizeof(T_Object))
+        {
+        m_peer.tune(cfg);
+        resync(m_dst.size()); // continue where the local mirror ends
+        }
+
+    // Ask the sender to restart the stream at from_index. Records at and
+    // above it are re-applied in place, so this also repairs a mirror.
+    void resync(uint64_t from_index)
+        {
+        if(from_index > m_dst.size())
+            throw std::out_of_range("resync beyond the end of the mirror");
+        ReplResyncReq const req {from_index};
+        if(!m_peer.send_all(&req, sizeof(req)))
+            throw std::runtime_error("replication sender went away");
+        m_expected = from_index;
+        }
+
+    // Applies frames until stop is set or the sender disconnects.
+    void run(std::atomic<bool> const& stop)
+        {
+        while(!stop.load(std::memory_order_relaxed))
+            if(m_peer.wait_readable(100) && !poll_one())
+                return;
+        }
+
+    // Receives and applies one frame. False when the sender is gone.
+    bool poll_one()
+        {
+        ReplFrameHdr hdr;
+        if(!m_peer.recv_all(&hdr, sizeof(hdr)))
+            return false;
+        if(hdr.bytes != hdr.num_records * sizeof(T_Object) || hdr.bytes > m_buf.size())
+            throw std::runtime_error("replication frame does not match record layout");
+        if(!m_peer.recv_all(m_buf.data(), hdr.bytes))
+            return false;
+        m_stats.bytes += sizeof(hdr) + hdr.bytes;
+        if(hdr.first_index > m_expected)
+            {
+            // Lost something in between: drop frames until the sender
+            // has rewound to the first index we are missing.
+            if(!m_gap_pending)
+                {
+                ++m_stats.gaps;
+                m_gap_pending = true;
+                ReplResyncReq const req {m_expected};
+                return m_peer.send_all(&req, sizeof(req));
+                }
+            return true;
+            }
+        m_gap_pending = false;
+        auto const* records = reinterpret_cast<T_Object const*>(m_buf.data());
+        for(uint32_t ii = 0; ii < hdr.num_records; ++ii)
+            apply(hdr.first_index + ii, records[ii]);
+        m_expected = std::max<uint64_t>(m_expected, hdr.first_index + hdr.num_records);
+        m_stats.records += hdr.num_records;
+        m_stats.batches += 1;
+        if(m_stats.latency_ns.size() < MAX_LATENCY_SAMPLES)
+            m_stats.latency_ns.push_back(steady_now_ns() - hdr.send_ns);
+        return true;
+        }
+
+    uint64_t expected_index() const {return m_expected;}
+    ReplicationStats const& stats() const {return m_stats;}
+
+private:
+    void apply(size_t idx, T_Object const& obj)
+        {
+        auto prod = idx < m_dst.size() ? m_dst.produce_begin(idx) : m_dst.emplace_back();
+        *prod = obj;
+        prod.produce_commit();
+        }
+
+    Producer&          m_dst;
+    ShmSocket          m_peer;
+    std::vector<char>  m_buf;
+    uint64_t           m_expected {};
+    bool               m_gap_pending {};
+    ReplicationStats   m_stats;
+};
+
+//==============================================================================
+// UDP multicast fan-out. ShmMulticastPublisher tails a consumer and packs
+// committed records into MTU-sized datagrams with a sequence number.
+// ShmMulticastSubscriber applies them into a local producer; when it sees a
+// hole it fetches the missing index range over TCP from a ShmSnapshotServer
+// running next to the publisher, then continues with the multicast stream.
+struct MulticastConfig
+{
+    char const* group           = "239.255.0.1";
+    uint16_t    port            = 15052;
+    char const* interface_ip    = "127.0.0.1";
+    uint8_t     ttl             = 1;
+    size_t      mtu_payload     = 1472;  // 1500 MTU - IP - UDP headers
+    uint32_t    heartbeat_us    = 1000;  // lets subscribers see tail losses
+    double      inject_loss     = 0;     // subscriber drops this fraction, tests only
+    int         socket_buf_bytes = 8 << 20;
+};
+
+struct McastDatagramHdr
+{
+    uint64_t seq;          // per-datagram, contiguous
+    uint64_t first_index;  // heartbeat: next index to be published
+    uint32_t num_records;  // 0 for heartbeats
+    uint32_t reserved;
+};
+
+struct ReplRangeReq
+{
+    uint64_t first_index;
+    uint64_t count;
+};
+
+inline ShmSocket udp_multicast_socket(MulticastConfig const& cfg, bool subscriber)
+{
+    ShmSocket s(::socket(AF_INET, SOCK_DGRAM, 0));
+    if(!s)
+        throw std::system_error(errno, std::generic_category(), "udp socket");
+    in_addr iface {};
+    ::inet_pton(AF_INET, cfg.interface_ip, &iface);
+    int const one = 1;
+    int const ttl = cfg.ttl;
+    bool ok = true;
+    if(subscriber)
+        {
+        ip_mreq mreq {};
+        ::inet_pton(AF_INET, cfg.group, &mreq.imr_multiaddr);
+        mreq.imr_interface = iface;
+        sockaddr_in addr {};
+        addr.sin_family = AF_INET;
+        addr.sin_port   = htons(cfg.port);
+        addr.sin_addr   = mreq.imr_multiaddr;
+        ok = !::setsockopt(s.fd(), SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one))
+          && !::setsockopt(s.fd(), SOL_SOCKET, SO_RCVBUF, &cfg.socket_buf_bytes, sizeof(int))
+          && !::bind(s.fd(), (sockaddr*)&addr, sizeof(addr))
+          && !::setsockopt(s.fd(), IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq, sizeof(mreq));
+        }
+    else
+        ok = !::setsockopt(s.fd(), IPPROTO_IP, IP_MULTICAST_IF, &iface, sizeof(iface))
+          && !::setsockopt(s.fd(), IPPROTO_IP, IP_MULTICAST_LOOP, &one, sizeof(one))
+          && !::setsockopt(s.fd(), IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl))
+          && !::setsockopt(s.fd(), SOL_SOCKET, SO_SNDBUF, &cfg.socket_buf_bytes, sizeof(int));
+    if(!ok)
+        throw std::system_error(errno, std::generic_category(), "udp multicast setup");
+    return s;
+}
+
+//==============================================================================
+// Serves arbitrary index ranges as ReplFrameHdr frames, one request per
+// connection. Used to recover multicast losses.
+template<typename T_Consumer> // ShmContainerConsumer<...>
+class ShmSnapshotServer
+{
+public:
+    using Consumer = T_Consumer;
+    using T_Object = typename Consumer::value_type;
+    static constexpr size_t FRAME_RECORDS = 4096;
+
+    ShmSnapshotServer(T_Consumer& source, char const* listen_ip, uint16_t port)
+        : m_src(source)
+        , m_listener(ShmSocket::listen_tcp(listen_ip, port))
+        , m_buf(FRAME_RECORDS)
+        {}
+
+    void run(std::atomic<bool> const& stop)
+        {
+        while(!stop.load(std::memory_order_relaxed))
+            {
+            ShmSocket peer = m_listener.accept(100);
+            ReplRangeReq req;
+            if(peer && peer.recv_all(&req, sizeof(req)))
+                serve(peer, req);
+            }
+        }
+
+    uint64_t ranges_served() const {return m_ranges_served;}
+
+private:
+    void serve(ShmSocket const& peer, ReplRangeReq req)
+        {
+        ++m_ranges_served;
+        while(req.count)
+            {
+            size_t const n = m_src.copy_committed(
+                req.first_index, std::min<uint64_t>(req.count, FRAME_RECORDS), m_buf.data());
+            if(!n)
+                return; // not committed (yet): the subscriber will ask again
+            ReplFrameHdr const hdr {uint32_t(n * sizeof(T_Object)), uint32_t(n),
+                                    req.first_index, steady_now_ns()};
+            if(!peer.send_all(&hdr, sizeof(hdr)) || !peer.send_all(m_buf.data(), hdr.bytes))
+                return;
+            req.first_index += n;
+            req.count       -= n;
+            }
+        }
+
+    Consumer&              m_src;
+    ShmSocket              m_listener;
+    std::vector<T_Object>  m_buf;
+    uint64_t               m_ranges_served {};
+};
+
+//==============================================================================
+template<typename T_Consumer> // ShmContainerConsumer<...>
+class ShmMulticastPublisher
+{
+public:
+    using Consumer = T_Consumer;
+    using T_Object = typename Consumer::value_type;
+
+    ShmMulticastPublisher(T_Consumer& source, MulticastConfig cfg = {})
+        : m_src(source), m_cfg(cfg)
+        , m_sock(udp_multicast_socket(cfg, false))
+        , m_records_per_datagram((cfg.mtu_payload - sizeof(McastDatagramHdr)) / sizeof(T_Object))
+        , m_buf(cfg.mtu_payload)
+        {
+        if(cfg.mtu_payload < sizeof(McastDatagramHdr) + sizeof(T_Object))
+            throw std::invalid_argument("record does not fit into one datagram");
+        ::inet_pton(AF_INET, cfg.group, &m_group.sin_addr);
+        m_group.sin_family = AF_INET;
+        m_group.sin_port   = htons(cfg.port);
+        }
+
+    // Publishes everything committed so far; returns records sent.
+    size_t poll_once()
+        {
+        size_t total = 0;
+        for(;;)
+            {
+            auto* const hdr = reinterpret_cast<McastDatagramHdr*>(m_buf.data());
+            auto* const records = reinterpret_cast<T_Object*>(hdr + 1);
+            size_t const n = m_src.copy_committed(m_next, m_records_per_datagram, records);
+            uint64_t const now = steady_now_ns();
+            if(!n && now - m_last_send_ns < m_cfg.heartbeat_us * 1000ull)
+                return total;
+            *hdr = McastDatagramHdr{m_seq++, m_next, uint32_t(n), 0};
+            ::sendto(m_sock.fd(), m_buf.data(), sizeof(*hdr) + n * sizeof(T_Object), 0,
+                     (sockaddr const*)&m_group, sizeof(m_group));
+            m_last_send_ns = now;
+            m_next += n;
+            total  += n;
+            if(n < m_records_per_datagram)
+                return total;
+            }
+        }
+
+    void run(std::atomic<bool> const& stop)
+        {
+        while(!stop.load(std::memory_order_relaxed))
+            if(!poll_once())
+                std::this_thread::yield();
+        }
+
+    uint64_t next_index() const {return m_next;}
+
+private:
+    Consumer&          m_src;
+    MulticastConfig    m_cfg;
+    ShmSocket          m_sock;
+    size_t const       m_records_per_datagram;
+    std::vector<char>  m_buf;
+    sockaddr_in        m_group {};
+    uint64_t           m_seq {};
+    uint64_t           m_next {};
+    uint64_t           m_last_send_ns {};
+};
+
+//==============================================================================
+template<typename T_Producer> // ShmContainerProducer<...>
+class ShmMulticastSubscriber
+{
+public:
+    using Producer = T_Producer;
+    using T_Object = typename Producer::value_type;
+
+    struct Stats
+    {
+        uint64_t datagrams {};
+        uint64_t records {};
+        uint64_t seq_gaps {};         // datagrams known to be lost
+        uint64_t injected_drops {};
+        uint64_t recovered_records {};
+    };
+
+    ShmMulticastSubscriber(T_Producer& mirror, char const* snapshot_ip,
+                           uint16_t snapshot_port, MulticastConfig cfg = {})
+        : m_dst(mirror), m_cfg(cfg)
+        , m_sock(udp_multicast_socket(cfg, true))
+        , m_snapshot_ip(snapshot_ip), m_snapshot_port(snapshot_port)
+        , m_buf(cfg.mtu_payload)
+        , m_next(mirror.size())
+        {}
+
+    // Applies one datagram if one arrives within timeout_ms.
+    bool poll_one(int timeout_ms)
+        {
+        if(!m_sock.wait_readable(timeout_ms))
+            return false;
+        ssize_t const len = ::recv(m_sock.fd(), m_buf.data(), m_buf.size(), 0);
+        if(len < ssize_t(sizeof(McastDatagramHdr)))
+            return false;
+        if(m_cfg.inject_loss > 0 && next_random() < m_cfg.inject_loss)
+            {
+            ++m_stats.injected_drops;
+            return true;
+            }
+        auto const& hdr = *reinterpret_cast<McastDatagramHdr const*>(m_buf.data());
+        if(size_t(len) != sizeof(hdr) + hdr.num_records * sizeof(T_Object))
+            throw std::runtime_error("multicast datagram does not match record layout");
+        ++m_stats.datagrams;
+        if(m_have_seq && hdr.seq > m_seq + 1)
+            m_stats.seq_gaps += hdr.seq - m_seq - 1;
+        m_seq = hdr.seq;
+        m_have_seq = true;
+        // Index is authoritative: it also covers losses before we joined
+        if(hdr.first_index > m_next)
+            recover(m_next, hdr.first_index - m_next);
+        auto const* records = reinterpret_cast<T_Object const*>(&hdr + 1);
+        for(uint32_t ii = 0; ii < hdr.num_records; ++ii)
+            if(hdr.first_index + ii >= m_next)
+                apply(hdr.first_index + ii, records[ii]);
+        m_stats.records += hdr.num_records;
+        return true;
+        }
+
+    void run(std::atomic<bool> const& stop)
+        {
+        while(!stop.load(std::memory_order_relaxed))
+            poll_one(100);
+        }
+
+    uint64_t next_index() const {return m_next;}
+    Stats const& stats() const {return m_stats;}
+
+private:
+    // Blocking TCP fetch of [first, first + count)
+    void recover(uint64_t first, uint64_t count)
+        {
+        ShmSocket peer = ShmSocket::connect_tcp(m_snapshot_ip, m_snapshot_port);
+        ReplRangeReq const req {first, count};
+        if(!peer.send_all(&req, sizeof(req)))
+            throw std::runtime_error("snapshot server went away");
+        std::vector<T_Object> records;
+        ReplFrameHdr hdr;
+        while(m_next < first + count && peer.recv_all(&hdr, sizeof(hdr)))
+            {
+            if(hdr.bytes != hdr.num_records * sizeof(T_Object) || hdr.first_index != m_next)
+                throw std::runtime_error("snapshot frame does not continue the mirror");
+            records.resize(hdr.num_records);
+            if(!peer.recv_all(records.data(), hdr.bytes))
+                break;
+            for(auto const& rec : records)
+                apply(m_next, rec);
+            m_stats.recovered_records += hdr.num_records;
+            }
+        if(m_next < first + count)
+            throw std::runtime_error("snapshot server could not fill the gap");
+        }
+
+    void apply(uint64_t idx, T_Object const& obj)
+        {
+        auto prod = idx < m_dst.size() ? m_dst.produce_begin(idx) : m_dst.emplace_back();
+        *prod = obj;
+        prod.produce_commit();
+        m_next = idx + 1;
+        }
+
+    double next_random() // xorshift64*, only drives the loss injector
+        {
+        m_rng ^= m_rng >> 12; m_rng ^= m_rng << 25; m_rng ^= m_rng >> 27;
+        return (m_rng * 2685821657736338717ull >> 11) * (1.0 / (1ull << 53));
+        }
+
+    Producer&          m_dst;
+    MulticastConfig    m_cfg;
+    ShmSocket          m_sock;
+    char const*        m_snapshot_ip;
+    uint16_t           m_snapshot_port;
+    std::vector<char>  m_buf;
+    uint64_t           m_next;
+    uint64_t           m_seq {};
+    bool               m_have_seq {};
+    uint64_t           m_rng {0x9E3779B97F4A7C15ull};
+    Stats              m_stats;
+};
+
+//==============================================================================
+// Minimal io_uring wrapper over the raw syscalls (no liburing dependency).
+class ShmUring
+{
+public:
+    explicit ShmUring(unsigned entries)
+        {
+        io_uring_params params {};
+        m_fd = int(::syscall(__NR_io_uring_setup, entries, &params));
+        if(m_fd < 0)
+            throw std::system_error(errno, std::generic_category(), "io_uring_setup");
+        m_sq_bytes = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        m_cq_bytes = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        m_sqe_bytes = params.sq_entries * sizeof(io_uring_sqe);
+        m_sq = map(m_sq_bytes, IORING_OFF_SQ_RING);
+        m_cq = map(m_cq_bytes, IORING_OFF_CQ_RING);
+        m_sqes = static_cast<io_uring_sqe*>(map(m_sqe_bytes, IORING_OFF_SQES));
+        auto sq = static_cast<char*>(m_sq);
+        auto cq = static_cast<char*>(m_cq);
+        m_sq_head  = reinterpret_cast<std::atomic<unsigned>*>(sq + params.sq_off.head);
+        m_sq_tail  = reinterpret_cast<std::atomic<unsigned>*>(sq + params.sq_off.tail);
+        m_sq_mask  = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        m_sq_array = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+        m_cq_head  = reinterpret_cast<std::atomic<unsigned>*>(cq + params.cq_off.head);
+        m_cq_tail  = reinterpret_cast<std::atomic<unsigned>*>(cq + params.cq_off.tail);
+        m_cq_mask  = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        m_cqes     = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+        m_sq_entries = params.sq_entries;
+        }
+    ~ShmUring()
+        {
+        ::munmap(m_sqes, m_sqe_bytes);
+        ::munmap(m_cq, m_cq_bytes);
+        ::munmap(m_sq, m_sq_bytes);
+        ::close(m_fd);
+        }
+    ShmUring(ShmUring const&) = delete;
+
+    void register_buffers(iovec const* iov, unsigned count)
+        {
+        if(::syscall(__NR_io_uring_register, m_fd, IORING_REGISTER_BUFFERS, iov, count))
+            throw std::system_error(errno, std::generic_category(), "io_uring_register");
+        }
+
+    // Returns a zeroed SQE, queued for the next submit(). Null if the SQ is full.
+    io_uring_sqe* get_sqe()
+        {
+        unsigned const tail = m_sq_tail->load(std::memory_order_relaxed) + m_pending;
+        if(tail - m_sq_head->load(std::memory_order_acquire) >= m_sq_entries)
+            return nullptr;
+        unsigned const slot = tail & m_sq_mask;
+        m_sq_array[slot] = slot;
+        ++m_pending;
+        return static_cast<io_uring_sqe*>(std::memset(&m_sqes[slot], 0, sizeof(io_uring_sqe)));
+        }
+
+    // Publishes queued SQEs and optionally waits for min_complete CQEs.
+    void submit(unsigned min_complete = 0)
+        {
+        unsigned const to_submit = m_pending;
+        m_sq_tail->store(m_sq_tail->load(std::memory_order_relaxed) + to_submit,
+                         std::memory_order_release);
+        m_pending = 0;
+        if(!to_submit && !min_complete)
+            return;
+        unsigned const flags = min_complete ? IORING_ENTER_GETEVENTS : 0;
+        while(::syscall(__NR_io_uring_enter, m_fd, to_submit, min_complete, flags, nullptr, 0) < 0)
+            if(errno != EINTR)
+                throw std::system_error(errno, std::generic_category(), "io_uring_enter");
+        }
+
+    // Calls on_cqe(user_data, res) for each completion; returns how many.
+    template<typename F>
+    unsigned reap(F&& on_cqe)
+        {
+        unsigned head = m_cq_head->load(std::memory_order_relaxed);
+        unsigned const tail = m_cq_tail->load(std::memory_order_acquire);
+        unsigned const count = tail - head;
+        for(; head != tail; ++head)
+            {
+            io_uring_cqe const& cqe = m_cqes[head & m_cq_mask];
+            on_cqe(cqe.user_data, cqe.res);
+            }
+        m_cq_head->store(tail, std::memory_order_release);
+        return count;
+        }
+
+private:
+    void* map(size_t bytes, off_t offset)
+        {
+        void* p = ::mmap(nullptr, bytes, PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_POPULATE, m_fd, offset);
+        if(p == MAP_FAILED)
+            throw std::system_error(errno, std::generic_category(), "io_uring mmap");
+        return p;
+        }
+
+    int                     m_fd {-1};
+    void*                   m_sq {};
+    void*                   m_cq {};
+    io_uring_sqe*           m_sqes {};
+    size_t                  m_sq_bytes {}, m_cq_bytes {}, m_sqe_bytes {};
+    std::atomic<unsigned>*  m_sq_head {};
+    std::atomic<unsigned>*  m_sq_tail {};
+    unsigned*               m_sq_array {};
+    unsigned                m_sq_mask {};
+    unsigned                m_sq_entries {};
+    unsigned                m_pending {};
+    std::atomic<unsigned>*  m_cq_head {};
+    std::atomic<unsigned>*  m_cq_tail {};
+    io_uring_cqe*           m_cqes {};
+    unsigned                m_cq_mask {};
+};
+
+//==============================================================================
+// Background recorder: tails a consumer and appends committed record ranges
+// to a journal file through io_uring, so the producer never pays for I/O.
+// The journal is a sequence of block-aligned chunks, each a JournalChunkHdr
+// followed by the records, zero-padded to JOURNAL_BLOCK for O_DIRECT.
+struct RecorderConfig
+{
+    enum class eFsync { NEVER, EVERY_BATCH, INTERVAL };
+    size_t   buffer_bytes       = 1 << 20; // one chunk per registered buffer
+    unsigned num_buffers        = 8;       // chunks in flight
+    uint32_t max_batch_delay_us = 1000;    // flush a partial chunk after this
+    eFsync   fsync_policy       = eFsync::INTERVAL;
+    uint32_t fsync_interval_ms  = 100;
+    bool     o_direct           = true;    // falls back to buffered on tmpfs
+};
+
+static constexpr size_t   JOURNAL_BLOCK = 4096;
+static constexpr uint64_t JOURNAL_MAGIC = 0x4c4e524a4d485321ull; // "!SHMJRNL"
+
+struct JournalChunkHdr
+{
+    uint64_t magic;
+    uint64_t first_index;
+    uint32_t num_records;
+    uint32_t record_size;
+    uint64_t chunk_bytes;  // including header and padding
+};
+
+template<typename T_Consumer> // ShmContainerConsumer<...>
+class ShmJournalRecorder
+{
+public:
+    using Consumer = T_Consumer;
+    using T_Object = typename Consumer::value_type;
+    using Config   = RecorderConfig;
+
+    ShmJournalRecorder(T_Consumer& source, std::string journal_path, Config cfg = {})
+        : m_src(source), m_cfg(cfg)
+        , m_ring(2 * cfg.num_buffers + 2)
+        , m_records_per_chunk((cfg.buffer_bytes - sizeof(JournalChunkHdr)) / sizeof(T_Object))
+        {
+        if(cfg.buffer_bytes % JOURNAL_BLOCK || !m_records_per_chunk || !cfg.num_buffers)
+            throw std::invalid_argument("recorder buffers must be whole blocks holding a record");
+        int const flags = O_WRONLY | O_CREAT | O_TRUNC;
+        m_fd = cfg.o_direct ? ::open(journal_path.c_str(), flags | O_DIRECT, 0644) : -1;
+        m_direct = m_fd >= 0;
+        if(!m_direct) // tmpfs and friends do not support O_DIRECT
+            m_fd = ::open(journal_path.c_str(), flags, 0644);
+        if(m_fd < 0)
+            throw std::system_error(errno, std::generic_category(), journal_path);
+        m_bufs.resize(cfg.num_buffers);
+        std::vector<iovec> iov;
+        for(auto& buf : m_bufs)
+            {
+            if(::posix_memalign(&buf.mem, JOURNAL_BLOCK, cfg.buffer_bytes))
+                throw std::bad_alloc();
+            iov.push_back(iovec{buf.mem, cfg.buffer_bytes});
+            }
+        m_ring.register_buffers(iov.data(), iov.size());
+        }
+    ~ShmJournalRecorder()
+        {
+        for(auto& buf : m_bufs)
+            ::free(buf.mem);
+        ::close(m_fd);
+        }
+
+    // Records until stop is set, then drains and (per policy) syncs.
+    void run(std::atomic<bool> const& stop)
+        {
+        while(!stop.load(std::memory_order_relaxed))
+            if(!poll_once())
+                std::this_thread::yield();
+        while(m_bufs[m_filling].count)
+            flush();
+        if(m_cfg.fsync_policy != Config::eFsync::NEVER)
+            queue_fsync();
+        while(m_in_flight)
+            complete(1);
+        }
+
+    // Captures what is available and reaps completions. Returns records captured.
+    size_t poll_once()
+        {
+        complete(0);
+        Buffer& buf = m_bufs[m_filling];
+        if(buf.in_flight)
+            return 0; // all buffers busy, the device is behind
+        auto* const records = reinterpret_cast<T_Object*>(
+            static_cast<char*>(buf.mem) + sizeof(JournalChunkHdr));
+        uint64_t const first = m_captured.load(std::memory_order_relaxed);
+        if(!buf.count)
+            buf.first_ns = steady_now_ns();
+        size_t const n = m_src.copy_committed(first, m_records_per_chunk - buf.count,
+                                              records + buf.count);
+        buf.count += n;
+        m_captured.store(first + n, std::memory_order_release);
+        bool const full    = buf.count == m_records_per_chunk;
+        bool const overdue = buf.count &&
+            steady_now_ns() - buf.first_ns >= m_cfg.max_batch_delay_us * 1000ull;
+        if(full || overdue)
+            flush();
+        if(m_cfg.fsync_policy == Config::eFsync::INTERVAL &&
+           steady_now_ns() - m_last_fsync_ns >= m_cfg.fsync_interval_ms * 1000000ull)
+            queue_fsync();
+        return n;
+        }
+
+    // Records committed in the container but not yet written to the journal
+    size_t   lag_records() const   {return m_src.size() - written_index();}
+    uint64_t captured_index() const {return m_captured.load(std::memory_order_acquire);}
+    uint64_t written_index() const  {return m_written.load(std::memory_order_acquire);}
+    uint64_t durable_index() const  {return m_durable.load(std::memory_order_acquire);}
+    bool     using_o_direct() const {return m_direct;}
+
+private:
+    static constexpr uint64_t FSYNC_TAG = ~0ull;
+
+    struct Buffer
+    {
+        void*    mem {};
+        uint64_t first_index {};
+        uint64_t first_ns {};
+        uint32_t count {};
+        bool     in_flight {};
+        bool     done {};
+    };
+
+    void flush()
+        {
+        Buffer& buf = m_bufs[m_filling];
+        size_t const used  = sizeof(JournalChunkHdr) + buf.count * sizeof(T_Object);
+        size_t const bytes = (used + JOURNAL_BLOCK - 1) / JOURNAL_BLOCK * JOURNAL_BLOCK;
+        buf.first_index = m_captured.load(std::memory_order_relaxed) - buf.count;
+        *static_cast<JournalChunkHdr*>(buf.mem) = JournalChunkHdr{
+            JOURNAL_MAGIC, buf.first_index, buf.count, sizeof(T_Object), bytes};
+        std::memset(static_cast<char*>(buf.mem) + used, 0, bytes - used);
+        io_uring_sqe* sqe;
+        while(!(sqe = m_ring.get_sqe()))
+            complete(1);
+        sqe->opcode    = IORING_OP_WRITE_FIXED;
+        sqe->fd        = m_fd;
+        sqe->addr      = uint64_t(buf.mem);
+        sqe->len       = bytes;
+        sqe->off       = m_file_off;
+        sqe->buf_index = m_filling;
+        sqe->user_data = m_filling;
+        m_file_off += bytes;
+        buf.in_flight = true;
+        ++m_in_flight;
+        if(m_cfg.fsync_policy == Config::eFsync::EVERY_BATCH)
+            queue_fsync();
+        m_ring.submit();
+        m_filling = (m_filling + 1) % m_bufs.size();
+        }
+
+    // IO_DRAIN: starts only after all earlier writes completed, so it
+    // covers everything submitted so far.
+    void queue_fsync()
+        {
+        io_uring_sqe* sqe;
+        while(!(sqe = m_ring.get_sqe()))
+            complete(1);
+        sqe->opcode      = IORING_OP_FSYNC;
+        sqe->fd          = m_fd;
+        sqe->fsync_flags = IORING_FSYNC_DATASYNC;
+        sqe->flags       = IOSQE_IO_DRAIN;
+        sqe->user_data   = FSYNC_TAG;
+        m_fsync_covers   = m_captured.load(std::memory_order_relaxed) - m_bufs[m_filling].count;
+        m_last_fsync_ns  = steady_now_ns();
+        ++m_in_flight;
+        m_ring.submit();
+        }
+
+    void complete(unsigned min_complete)
+        {
+        if(min_complete)
+            m_ring.submit(min_complete);
+        m_ring.reap([this](uint64_t tag, int res)
+            {
+            --m_in_flight;
+            if(res < 0)
+                throw std::system_error(-res, std::generic_category(), "journal write");
+            if(tag == FSYNC_TAG)
+                m_durable.store(std::max(m_durable.load(std::memory_order_relaxed), m_fsync_covers),
+                                std::memory_order_release);
+            else
+                m_bufs[tag].done = true;
+            });
+        // Writes may complete out of order; publish the contiguous prefix
+        for(Buffer* buf = &m_bufs[m_oldest]; buf->in_flight && buf->done; buf = &m_bufs[m_oldest])
+            {
+            m_written.store(buf->first_index + buf->count, std::memory_order_release);
+            *buf = Buffer{buf->mem};
+            m_oldest = (m_oldest + 1) % m_bufs.size();
+            }
+        }
+
+    Consumer&              m_src;
+    Config                 m_cfg;
+    ShmUring               m_ring;
+    size_t const           m_records_per_chunk;
+    int                    m_fd {-1};
+    bool                   m_direct {};
+    std::vector<Buffer>    m_bufs;
+    unsigned               m_filling {};
+    unsigned               m_oldest {};
+    unsigned               m_in_flight {};
+    uint64_t               m_file_off {};
+    uint64_t               m_fsync_covers {};
+    uint64_t               m_last_fsync_ns {};
+    std::atomic<uint64_t>  m_captured {};
+    std::atomic<uint64_t>  m_written {};
+    std::atomic<uint64_t>  m_durable {};
+};
+
+// Reads a journal back, calling on_record(index, obj) for every record.
+template<typename T_Object, typename F>
+size_t replay_journal(std::string const& journal_path, F&& on_record)
+{
+    int const fd = ::open(journal_path.c_str(), O_RDONLY);
+    if(fd < 0)
+        throw std::system_error(errno, std::generic_category(), journal_path);
+    size_t total = 0;
+    std::vector<char> chunk;
+    JournalChunkHdr hdr;
+    for(off_t off = 0; ::pread(fd, &hdr, sizeof(hdr), off) == sizeof(hdr); off += hdr.chunk_bytes)
+        {
+        if(hdr.magic != JOURNAL_MAGIC || hdr.record_size != sizeof(T_Object))
+            break; // torn or foreign tail
+        chunk.resize(hdr.chunk_bytes);
+        if(::pread(fd, chunk.data(), hdr.chunk_bytes, off) != ssize_t(hdr.chunk_bytes))
+            break;
+        auto const* records = reinterpret_cast<T_Object const*>(chunk.data() + sizeof(hdr));
+        for(uint32_t ii = 0; ii < hdr.num_records; ++ii)
+            on_record(hdr.first_index + ii, records[ii]);
+        total += hdr.num_records;
+        }
+    ::close(fd);
+    return total;
+}
+
+//==============================================================================
+// Background scrubber for checksummed containers: walks ranges in small
+// slices at idle priority and reports records whose CRC32C does not match.
+template<typename T_Consumer> // ShmContainerConsumer<..., A_Checksum = true>
+class ShmChecksumScrubber
+{
+public:
+    using Consumer = T_Consumer;
+    using eCheck   = typename Consumer::eCheck;
+    static_assert(Consumer::CHECKSUMMED, "scrubbing needs a checksummed container");
+
+    struct Config
+    {
+        size_t   slice_records  = 4096;  // records verified between pauses
+        uint32_t pause_us       = 200;   // yield the core between slices
+        unsigned busy_retries   = 3;     // then skip, the writer may have died
+        bool     idle_priority  = true;  // SCHED_IDLE for the scrubbing thread
+    };
+
+    explicit ShmChecksumScrubber(T_Consumer& source, Config cfg = {})
+        : m_src(source), m_cfg(cfg)
+        {}
+
+    // One pass over [first, last). Calls on_corrupt(index) for each bad record.
+    template<typename F>
+    void scrub(size_t first, size_t last, F&& on_corrupt, std::atomic<bool> const* stop = nullptr)
+        {
+        last = std::min(last, m_src.size());
+        for(size_t idx = first; idx < last; )
+            {
+            size_t const slice_begin = idx;
+            size_t const slice_end   = std::min(last, idx + m_cfg.slice_records);
+            for(; idx < slice_end; ++idx)
+                {
+                eCheck res = m_src.check_record(idx);
+                for(unsigned ii = 0; eCheck::BUSY == res && ii < m_cfg.busy_retries; ++ii)
+                    res = m_src.check_record(idx);
+                if(eCheck::CORRUPT == res)
+                    {
+                    m_corrupt.fetch_add(1, std::memory_order_relaxed);
+                    on_corrupt(idx);
+                    }
+                else if(eCheck::BUSY == res)
+                    m_busy_skipped.fetch_add(1, std::memory_order_relaxed);
+                }
+            m_scanned.fetch_add(slice_end - slice_begin, std::memory_order_relaxed);
+            if(stop && stop->load(std::memory_order_relaxed))
+                return;
+            if(m_cfg.pause_us)
+                std::this_thread::sleep_for(std::chrono::microseconds(m_cfg.pause_us));
+            }
+        }
+
+    // Scrubs the whole container over and over until stop is set.
+    template<typename F>
+    void run(std::atomic<bool> const& stop, F&& on_corrupt)
+        {
+        if(m_cfg.idle_priority)
+            {
+            sched_param const param {};
+            ::pthread_setschedparam(::pthread_self(), SCHED_IDLE, &param);
+            }
+        while(!stop.load(std::memory_order_relaxed))
+            {
+            scrub(0, m_src.size(), on_corrupt, &stop);
+            m_passes.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+
+    uint64_t scanned() const      {return m_scanned.load(std::memory_order_relaxed);}
+    uint64_t corrupt() const      {return m_corrupt.load(std::memory_order_relaxed);}
+    uint64_t busy_skipped() const {return m_busy_skipped.load(std::memory_order_relaxed);}
+    uint64_t passes() const       {return m_passes.load(std::memory_order_relaxed);}
+
+private:
+    T_Consumer&            m_src;
+    Config                 m_cfg;
+    std::atomic<uint64_t>  m_scanned {};
+    std::atomic<uint64_t>  m_corrupt {};
+    std::atomic<uint64_t>  m_busy_skipped {};
+    std::atomic<uint64_t>  m_passes {};
+};
+
+//==============================================================================
+// Background msync for durable mode, see ShmContainerBase::sync_durable().
+template<typename T_Producer> // ShmContainerProducer<...>
+class ShmDurableSyncer
+{
+public:
+    struct Config
+    {
+        uint32_t interval_ms      = 10;
+        bool     include_in_place = false; // also persist in-place updates
+    };
+
+    explicit ShmDurableSyncer(T_Producer& container, Config cfg = {})
+        : m_dst(container), m_cfg(cfg)
+        {}
+
+    // Syncs every interval until stop is set, then once more.
+    void run(std::atomic<bool> const& stop)
+        {
+        while(!stop.load(std::memory_order_relaxed))
+            {
+            std::this_thread::sleep_for(std::chrono::milliseconds(m_cfg.interval_ms));
+            sync_once();
+            }
+        sync_once();
+        }
+
+    void sync_once()
+        {
+        uint64_t const t0 = steady_now_ns();
+        m_dst.sync_durable(m_cfg.include_in_place);
+        m_last_sync_ns.store(steady_now_ns() - t0, std::memory_order_relaxed);
+        m_syncs.fetch_add(1, std::memory_order_relaxed);
+        }
+
+    uint64_t syncs() const        {return m_syncs.load(std::memory_order_relaxed);}
+    uint64_t last_sync_ns() const {return m_last_sync_ns.load(std::memory_order_relaxed);}
+    // Committed records that would be lost by a crash right now
+    size_t   lag_records() const  {return m_dst.size() - m_dst.durable_size();}
+
+private:
+    T_Producer&            m_dst;
+    Config                 m_cfg;
+    std::atomic<uint64_t>  m_syncs {};
+    std::atomic<uint64_t>  m_last_sync_ns {};
+};
+
+//==============================================================================
+// Sharded containers: N independent single-producer containers, one file
+// each, so every shard has its own header and record pages and can be
+// driven by its own producer thread. Keys are hashed to shards; records
+// are addressed as (shard, index).
+struct ShardedIndex
+{
+    uint32_t shard;
+    size_t   index;
+};
+
+inline std::string shard_file_path(std::string const& path_prefix, size_t shard)
+{
+    return path_prefix + ".shard" + std::to_string(shard);
+}
+
+inline size_t shard_of_key(uint64_t key, size_t num_shards)
+{
+    return ((key * 0x9E3779B97F4A7C15ull) >> 32) % num_shards; // Fibonacci hashing
+}
+
+template<typename T_Producer> // ShmContainerProducer<...>
+class ShmShardedProducer
+{
+public:
+    using T_Object = typename T_Producer::value_type;
+
+    ShmShardedProducer(size_t num_shards, size_t capacity_per_shard, std::string const& path_prefix)
+        {
+        m_shards.reserve(num_shards);
+        for(size_t ii = 0; ii < num_shards; ++ii)
+            m_shards.emplace_back(capacity_per_shard, shard_file_path(path_prefix, ii));
+        }
+
+    size_t num_shards() const             {return m_shards.size();}
+    size_t shard_for(uint64_t key) const  {return shard_of_key(key, m_shards.size());}
+    // Each shard must be written by one thread only
+    T_Producer& shard(size_t shard_idx)   {return m_shards[shard_idx];}
+
+    // Appends to the key's shard; only for the thread owning that shard.
+    ShardedIndex push_back(uint64_t key, T_Object const& obj)
+        {
+        size_t const shard_idx = shard_for(key);
+        auto prod = m_shards[shard_idx].emplace_back();
+        *prod = obj;
+        return ShardedIndex{uint32_t(shard_idx), m_shards[shard_idx].size() - 1};
+        }
+
+private:
+    std::vector<T_Producer> m_shards;
+};
+
+//==============================================================================
+template<typename T_Consumer> // ShmContainerConsumer<...>
+class ShmShardedConsumer
+{
+public:
+    using T_Object = typename T_Consumer::value_type;
+
+    ShmShardedConsumer(size_t num_shards, size_t capacity_per_shard, std::string const& path_prefix)
+        {
+        m_shards.reserve(num_shards);
+        for(size_t ii = 0; ii < num_shards; ++ii)
+            m_shards.emplace_back(capacity_per_shard, shard_file_path(path_prefix, ii));
+        }
+
+    size_t num_shards() const             {return m_shards.size();}
+    size_t shard_for(uint64_t key) const  {return shard_of_key(key, m_shards.size());}
+    T_Consumer& shard(size_t shard_idx)   {return m_shards[shard_idx];}
+    size_t size() const
+        {
+        size_t total = 0;
+        for(auto const& shard : m_shards)
+            total += shard.size();
+        return total;
+        }
+
+    auto consume_begin(ShardedIndex at) {return m_shards[at.shard].consume_begin(at.index);}
+    bool try_copy(ShardedIndex at, T_Object& out) const
+        {return m_shards[at.shard].try_copy(at.index, out);}
+
+    // Merges the shards' committed records into one stream ordered by
+    // T_Less, assuming each shard is already ordered by it (e.g. by
+    // timestamp). next() returns false when no shard has a committed
+    // record right now; call again later to keep tailing.
+    template<typename T_Less>
+    class MergeCursor
+    {
+    public:
+        MergeCursor(ShmShardedConsumer& src, T_Less less = {})
+            : m_src(src), m_less(less)
+            , m_next(src.num_shards())
+            , m_pending(src.num_shards(), true)
+            , m_heads(src.num_shards())
+            {}
+
+        bool next(ShardedIndex& at, T_Object& out)
+            {
+            // Refill heads of shards that were drained on the last call
+            for(uint32_t shard = 0; shard < m_pending.size(); ++shard)
+                if(m_pending[shard] && m_src.try_copy({shard, m_next[shard]}, m_heads[shard]))
+                    {
+                    m_pending[shard] = false;
+                    m_heap.push_back(shard);
+                    std::push_heap(m_heap.begin(), m_heap.end(), heap_cmp());
+                    }
+            if(m_heap.empty())
+                return false;
+            std::pop_heap(m_heap.begin(), m_heap.end(), heap_cmp());
+            uint32_t const shard = m_heap.back();
+            m_heap.pop_back();
+            at  = ShardedIndex{shard, m_next[shard]++};
+            out = m_heads[shard];
+            if(m_src.try_copy({shard, m_next[shard]}, m_heads[shard]))
+                {
+                m_heap.push_back(shard);
+                std::push_heap(m_heap.begin(), m_heap.end(), heap_cmp());
+                }
+            else
+                m_pending[shard] = true;
+            return true;
+            }
+
+    private:
+        T_Object& m_head_obj(uint32_t shard)
+            {
+            if(m_heads.size() <= shard)
+                m_heads.resize(m_src.num_shards());
+            return m_heads[shard];
+            }
+        auto heap_cmp() const // min-heap on T_Less, ties by shard
+            {
+            return [this](uint32_t lhs, uint32_t rhs)
+                {
+                if(m_less(m_heads[rhs], m_heads[lhs])) return true;
+                if(m_less(m_heads[lhs], m_heads[rhs])) return false;
+                return lhs > rhs;
+                };
+            }
+
+        ShmShardedConsumer&    m_src;
+        T_Less                 m_less;
+        std::vector<size_t>    m_next;    // per shard: index of its head
+        std::vector<char>      m_pending; // per shard: head not loaded yet
+        std::vector<T_Object>  m_heads;
+        std::vector<uint32_t>  m_heap;
+    };
+
+    template<typename T_Less>
+    MergeCursor<T_Less> merge(T_Less less = {}) {return MergeCursor<T_Less>(*this, less);}
+
+private:
+    std::vector<T_Consumer> m_shards;
+};
+
+//==============================================================================
+// Event-time merge of several append-only containers (e.g. NSE, BSE, MCX).
+// A loser tree over the sources' head timestamps picks the next record in
+// O(log K); only the winner is copied out. A source with nothing committed
+// blocks the merge unless the candidate is older than the newest timestamp
+// seen minus the lateness watermark; records that show up after that
+// are "late" and are either emitted out of order or dropped.
+template<typename T_Consumer, typename T_TimeOf> // T_TimeOf: uint64_t(T_Object const&)
+class ShmMergeConsumer
+{
+public:
+    using T_Object = typename T_Consumer::value_type;
+
+    struct Config
+    {
+        uint64_t lateness  = 0;     // in T_TimeOf units
+        bool     drop_late = false;
+    };
+    struct Stats
+    {
+        uint64_t emitted {};
+        uint64_t late {};           // emitted (or dropped) out of order
+        uint64_t dropped {};
+    };
+
+    ShmMergeConsumer(std::vector<T_Consumer*> sources, T_TimeOf time_of = {}, Config cfg = {})
+        : m_src(std::move(sources)), m_time_of(time_of), m_cfg(cfg)
+        , m_head(m_src.size())
+        {
+        if(m_src.empty())
+            throw std::invalid_argument("merge needs at least one source");
+        for(m_leaves = 1; m_leaves < m_src.size(); m_leaves *= 2) {}
+        m_key.assign(m_leaves, EMPTY);
+        m_tree.assign(m_leaves, 0);
+        for(uint32_t src = 0; src < m_src.size(); ++src)
+            m_empty.push_back(src);
+        build();
+        }
+
+    // Starts source src at index instead of 0, e.g. to resume
+    void seek(size_t src, size_t index) {m_head[src] = index; refill(src);}
+
+    // The next record in timestamp order. False if the merge must wait.
+    bool next(size_t& src_out, size_t& index_out, T_Object& out)
+        {
+        for(;;)
+            {
+            for(size_t ii = 0; ii < m_empty.size(); )
+                if(refill(m_empty[ii]))
+                    m_empty[ii] = m_empty.back(), m_empty.pop_back();
+                else
+                    ++ii;
+            uint32_t const win = m_tree[0];
+            uint64_t const ts  = m_key[win];
+            if(EMPTY == ts)
+                return false;
+            if(!m_empty.empty() && !below_watermark(ts))
+                {
+                peek_tails();
+                if(!below_watermark(ts))
+                    return false; // an idle source could still produce something older
+                }
+            if(!m_src[win]->try_copy(m_head[win], out))
+                return false;
+            size_t const index = m_head[win]++;
+            bool const late = ts < m_last_emitted;
+            if(!refill(win))
+                m_empty.push_back(win);
+            if(late)
+                {
+                ++m_stats.late;
+                if(m_cfg.drop_late)
+                    {
+                    ++m_stats.dropped;
+                    continue;
+                    }
+                }
+            m_last_emitted = std::max(m_last_emitted, ts);
+            ++m_stats.emitted;
+            src_out   = win;
+            index_out = index;
+            return true;
+            }
+        }
+
+    Stats const& stats() const {return m_stats;}
+
+private:
+    static constexpr uint64_t EMPTY = ~0ull;
+
+    bool below_watermark(uint64_t ts) const
+        {return m_max_seen >= m_cfg.lateness && ts <= m_max_seen - m_cfg.lateness;}
+
+    // The newest committed timestamps tell how far event time has moved on
+    void peek_tails()
+        {
+        for(size_t src = 0; src < m_src.size(); ++src)
+            {
+            uint64_t ts;
+            size_t const size = m_src[src]->size();
+            if(size && m_src[src]->try_project(size - 1, m_time_of, ts))
+                m_max_seen = std::max(m_max_seen, ts);
+            }
+        }
+
+    // Loads the head timestamp of src; false (and EMPTY) if not committed yet
+    bool refill(uint32_t src)
+        {
+        uint64_t ts = EMPTY;
+        bool const ok = m_head[src] < m_src[src]->size()
+                     && m_src[src]->try_project(m_head[src], m_time_of, ts);
+        m_key[src] = ok ? ts : EMPTY;
+        if(ok)
+            m_max_seen = std::max(m_max_seen, ts);
+        if(src == m_tree[0])
+            replay(src);
+        else
+            build(); // replay is only valid for the winner's leaf; rare
+        return ok;
+        }
+
+    bool beats(uint32_t lhs, uint32_t rhs) const
+        {return m_key[lhs] < m_key[rhs] || (m_key[lhs] == m_key[rhs] && lhs < rhs);}
+
+    void build()
+        {
+        std::vector<uint32_t> winner(2 * m_leaves);
+        for(uint32_t leaf = 0; leaf < m_leaves; ++leaf)
+            winner[m_leaves + leaf] = leaf;
+        for(size_t node = m_leaves - 1; node >= 1; --node)
+            {
+            uint32_t const lhs = winner[2 * node], rhs = winner[2 * node + 1];
+            winner[node] = beats(lhs, rhs) ? lhs : rhs;
+            m_tree[node] = beats(lhs, rhs) ? rhs : lhs;
+            }
+        m_tree[0] = winner[m_leaves > 1 ? 1 : m_leaves];
+        }
+
+    // Leaf's key changed: replay its matches up to the root
+    void replay(uint32_t leaf)
+        {
+        uint32_t win = leaf;
+        for(size_t node = (m_leaves + leaf) / 2; node >= 1; node /= 2)
+            if(beats(m_tree[node], win))
+                std::swap(m_tree[node], win);
+        m_tree[0] = win;
+        }
+
+    std::vector<T_Consumer*> m_src;
+    T_TimeOf                 m_time_of;
+    Config                   m_cfg;
+    std::vector<size_t>      m_head;    // next index per source
+    size_t                   m_leaves {};
+    std::vector<uint64_t>    m_key;     // head timestamp per leaf
+    std::vector<uint32_t>    m_tree;    // [0] winner, [1..) losers
+    std::vector<uint32_t>    m_empty;   // sources without a committed head
+    uint64_t                 m_max_seen {};
+    uint64_t                 m_last_emitted {};
+    Stats                    m_stats;
+};
+
+//==============================================================================
+// Incremental OHLC/VWAP bars as a pipeline stage. ShmBarBuilder tails a
+// tick container and keeps one live bar per (instrument, interval) in a
+// bar container, updated in place on every tick. When an interval ends the
+// closed bar is also appended after the live region, so bar consumers can
+// either poll the live bars or tail the closed ones.
+static constexpr size_t MAX_BAR_INTERVALS = 8;
+
+struct OhlcBar
+{
+    uint64_t start_ns;
+    uint64_t interval_ns;
+    uint32_t instrument;
+    uint32_t num_ticks;
+    double   open, high, low, close;
+    double   volume;
+    double   vwap;
+    uint32_t closed;      // 1 once the interval is over
+    uint32_t reserved;
+};
+
+struct BarHeader // user header of the bar container
+{
+    uint32_t max_instruments;
+    uint32_t num_intervals;
+    uint64_t interval_ns[MAX_BAR_INTERVALS];
+
+    size_t live_bar_index(uint32_t instrument, size_t interval_idx) const
+        {return size_t(instrument) * num_intervals + interval_idx;}
+    size_t first_closed_index() const
+        {return size_t(max_instruments) * num_intervals;}
+};
+
+// What the builder needs from a tick
+struct BarTick
+{
+    uint32_t instrument;  // dense, < max_instruments
+    uint64_t ts_ns;
+    double   px;
+    double   qty;
+};
+
+using ShmBarProducer = ShmContainerProducer<OhlcBar, uint32_t, BarHeader>;
+using ShmBarConsumer = ShmContainerConsumer<OhlcBar, uint32_t, BarHeader>;
+
+template<typename T_TickConsumer, typename T_TickOf> // T_TickOf: BarTick(T_Object const&)
+class ShmBarBuilder
+{
+public:
+    using T_Tick = typename T_TickConsumer::value_type;
+    static constexpr size_t BATCH = 1024;
+
+    ShmBarBuilder(T_TickConsumer& ticks, ShmBarProducer& bars, uint32_t max_instruments,
+                  std::vector<uint64_t> intervals_ns, T_TickOf tick_of = {})
+        : m_ticks(ticks), m_bars(bars), m_tick_of(tick_of)
+        , m_batch(BATCH)
+        {
+        if(intervals_ns.empty() || intervals_ns.size() > MAX_BAR_INTERVALS)
+            throw std::invalid_argument("bar builder needs 1..MAX_BAR_INTERVALS intervals");
+        BarHeader& hdr = m_bars.user_header();
+        hdr.max_instruments = max_instruments;
+        hdr.num_intervals   = intervals_ns.size();
+        std::copy(intervals_ns.begin(), intervals_ns.end(), hdr.interval_ns);
+        m_hdr = hdr;
+        m_live.resize(hdr.first_closed_index());
+        while(m_bars.size() < hdr.first_closed_index()) // reserve the live region
+            m_bars.emplace_back();
+        m_min_interval = *std::min_element(intervals_ns.begin(), intervals_ns.end());
+        }
+
+    // Processes what is committed; returns ticks consumed.
+    size_t poll_once()
+        {
+        size_t const n = m_ticks.copy_committed(m_next, BATCH, m_batch.data());
+        for(size_t ii = 0; ii < n; ++ii)
+            on_tick(m_tick_of(m_batch[ii]));
+        m_next += n;
+        return n;
+        }
+
+    void run(std::atomic<bool> const& stop)
+        {
+        while(!stop.load(std::memory_order_relaxed))
+            if(!poll_once())
+                std::this_thread::yield();
+        }
+
+    // Closes every live bar whose interval ended before event time now_ns.
+    // Called automatically whenever ticks cross an interval boundary.
+    void close_elapsed(uint64_t now_ns)
+        {
+        for(size_t slot = 0; slot < m_live.size(); ++slot)
+            {
+            LiveBar& live = m_live[slot];
+            if(live.bar.num_ticks && live.bar.start_ns + live.bar.interval_ns <= now_ns)
+                close(slot, live);
+            }
+        }
+
+    uint64_t ticks_consumed() const {return m_next;}
+    uint64_t bars_closed() const    {return m_closed;}
+
+private:
+    struct LiveBar
+    {
+        OhlcBar bar {};
+        double  px_qty {}; // running sum for the VWAP
+    };
+
+    void on_tick(BarTick const& tick)
+        {
+        if(tick.instrument >= m_hdr.max_instruments)
+            return;
+        if(tick.ts_ns / m_min_interval != m_clock / m_min_interval && m_clock)
+            close_elapsed(tick.ts_ns);
+        m_clock = std::max(m_clock, tick.ts_ns);
+        for(size_t kk = 0; kk < m_hdr.num_intervals; ++kk)
+            {
+            size_t const slot = m_hdr.live_bar_index(tick.instrument, kk);
+            LiveBar& live = m_live[slot];
+            OhlcBar& bar  = live.bar;
+            uint64_t const interval = m_hdr.interval_ns[kk];
+            uint64_t const start = tick.ts_ns - tick.ts_ns % interval;
+            if(bar.num_ticks && start > bar.start_ns)
+                close(slot, live);
+            if(!bar.num_ticks)
+                {
+                bar = OhlcBar{start, interval, tick.instrument, 0,
+                              tick.px, tick.px, tick.px, tick.px, 0, 0, 0, 0};
+                live.px_qty = 0;
+                }
+            bar.high    = std::max(bar.high, tick.px);
+            bar.low     = std::min(bar.low, tick.px);
+            bar.close   = tick.px;
+            bar.volume += tick.qty;
+            live.px_qty += tick.px * tick.qty;
+            bar.vwap    = bar.volume > 0 ? live.px_qty / bar.volume : tick.px;
+            bar.num_ticks += 1;
+            *m_bars.produce_begin(slot) = bar;
+            }
+        }
+
+    void close(size_t slot, LiveBar& live)
+        {
+        live.bar.closed = 1;
+        *m_bars.produce_begin(slot) = live.bar;
+        if(m_bars.size() < m_bars.capacity())
+            *m_bars.emplace_back() = live.bar;
+        live.bar.num_ticks = 0;
+        ++m_closed;
+        }
+
+    T_TickConsumer&        m_ticks;
+    ShmBarProducer&        m_bars;
+    T_TickOf               m_tick_of;
+    BarHeader              m_hdr {};
+    std::vector<LiveBar>   m_live;
+    std::vector<T_Tick>    m_batch;
+    uint64_t               m_next {};
+    uint64_t               m_clock {};  // newest event time seen
+    uint64_t               m_min_interval {};
+    uint64_t               m_closed {};
+};
+
+//==============================================================================
+// Incrementally maintained top-N view. The producer reports each in-place
+// update; a max tournament tree over all records' scores (a user
+// projection) is updated in O(log M), and the ranked list is republished
+// only if the update can change it. The list lives in a one-record shared
+// container, so consumers get a consistent ranking with one seqlock read.
+template<size_t A_N>
+struct TopNView
+{
+    struct Entry
+    {
+        uint64_t index;   // record index in the base container
+        double   score;
+    };
+    uint32_t count;       // valid entries, best first
+    uint32_t reserved;
+    uint64_t updates;     // base updates folded in so far
+    Entry    entries[A_N];
+};
+
+template<size_t A_N> using ShmTopNConsumer = ShmContainerConsumer<TopNView<A_N>>;
+
+template<typename T_Object, size_t A_N, typename T_ScoreOf> // T_ScoreOf: double(T_Object const&)
+class ShmTopN
+{
+public:
+    using View = TopNView<A_N>;
+
+    ShmTopN(size_t max_records, std::string view_file_path, T_ScoreOf score_of = {})
+        : m_view(1, view_file_path), m_score_of(score_of)
+        {
+        for(m_leaves = 1; m_leaves < max_records; m_leaves *= 2) {}
+        m_score.assign(m_leaves, NO_SCORE);
+        m_tree.resize(m_leaves);
+        for(size_t node = m_leaves - 1; node >= 1; --node)
+            m_tree[node] = winner(child_best(2 * node), child_best(2 * node + 1));
+        m_in_view.assign(m_leaves, false);
+        if(!m_view.size())
+            m_view.emplace_back();
+        publish();
+        }
+
+    // Call after each update of base record index; O(log M).
+    void on_update(size_t index, T_Object const& obj)
+        {
+        double const score = m_score_of(obj);
+        m_score[index] = score;
+        for(size_t node = (m_leaves + index) / 2; node >= 1; node /= 2)
+            m_tree[node] = winner(child_best(2 * node), child_best(2 * node + 1));
+        ++m_updates;
+        if(m_in_view[index] || m_count < A_N || score > m_threshold)
+            publish();
+        }
+
+    uint64_t publishes() const {return m_publishes;}
+
+private:
+    static constexpr double NO_SCORE = -std::numeric_limits<double>::infinity();
+
+    uint32_t child_best(size_t node) const
+        {return node >= m_leaves ? uint32_t(node - m_leaves) : m_tree[node];}
+    uint32_t winner(uint32_t lhs, uint32_t rhs) const
+        {return m_score[rhs] > m_score[lhs] ? rhs : lhs;}
+
+    // Best-first walk of the tournament tree: O(N log N) heap operations
+    void publish()
+        {
+        for(size_t ii = 0; ii < m_count; ++ii)
+            m_in_view[m_ranked[ii].index] = false;
+        m_count = 0;
+        auto const cmp = [this](size_t lhs, size_t rhs)
+            {return m_score[child_best(lhs)] < m_score[child_best(rhs)];};
+        m_frontier.assign(1, m_leaves > 1 ? 1 : m_leaves);
+        while(m_count < A_N && !m_frontier.empty())
+            {
+            std::pop_heap(m_frontier.begin(), m_frontier.end(), cmp);
+            size_t const node = m_frontier.back();
+            m_frontier.pop_back();
+            uint32_t const best = child_best(node);
+            if(NO_SCORE == m_score[best])
+                break;
+            if(node >= m_leaves)
+                {
+                m_ranked[m_count++] = typename View::Entry{best, m_score[best]};
+                m_in_view[best] = true;
+                continue;
+                }
+            for(size_t child : {2 * node, 2 * node + 1})
+                {
+                m_frontier.push_back(child);
+                std::push_heap(m_frontier.begin(), m_frontier.end(), cmp);
+                }
+            }
+        m_threshold = m_count == A_N ? m_ranked[A_N - 1].score : NO_SCORE;
+        auto vptr = m_view.produce_begin(0);
+        vptr->count   = m_count;
+        vptr->updates = m_updates;
+        std::memcpy(vptr->entries, m_ranked, m_count * sizeof(typename View::Entry));
+        ++m_publishes;
+        }
+
+    ShmContainerProducer<View>  m_view;
+    T_ScoreOf                   m_score_of;
+    size_t                      m_leaves {};
+    std::vector<double>         m_score;     // per record
+    std::vector<uint32_t>       m_tree;      // per internal node: best record below
+    std::vector<char>           m_in_view;
+    std::vector<size_t>         m_frontier;
+    typename View::Entry        m_ranked[A_N] {};
+    size_t                      m_count {};
+    double                      m_threshold {NO_SCORE};
+    uint64_t                    m_updates {};
+    uint64_t                    m_publishes {};
+};
+
+//==============================================================================
+// Shared-memory price-level order book, built from two containers:
+// - levels: one record per (instrument, side, price tick), versioned per level
+// - sides:  one record per (instrument, side) on its own cache line, holding
+//   the cached best price; its version doubles as the side's seqlock, since
+//   the producer holds it open while it touches that side's levels.
+// Consumers read the BBO with one seqlock read per side and a consistent
+// top-K by validating the side version around the ladder walk.
+struct BookLevel
+{
+    int64_t  qty;
+    uint32_t orders;
+    uint32_t reserved;
+};
+
+struct alignas(64) BookSide
+{
+    int64_t  base_px;      // price of ladder level 0, in ticks
+    int64_t  best_px;      // cached top of this side, valid if best_qty > 0
+    int64_t  best_qty;
+    uint32_t best_level;
+    uint32_t levels_used;  // non-empty levels
+    uint64_t updates;
+};
+
+struct BookHeader
+{
+    uint32_t num_instruments;
+    uint32_t num_levels;   // ladder length per side
+};
+
+enum class eBookSide : uint32_t { BID = 0, ASK = 1 };
+
+struct BookMsg
+{
+    enum class eType : uint32_t { ADD, MODIFY, DELETE };
+    eType     type;        // ADD: += qty, one more order; MODIFY: = qty; DELETE: clear
+    eBookSide side;
+    uint32_t  instrument;
+    int64_t   px;          // in ticks
+    int64_t   qty;
+};
+
+inline std::string book_levels_path(std::string const& path) {return path + ".levels";}
+inline std::string book_sides_path(std::string const& path)  {return path + ".sides";}
+
+class ShmOrderBookProducer
+{
+public:
+    ShmOrderBookProducer(uint32_t num_instruments, uint32_t num_levels, std::string const& path)
+        : m_levels(size_t(num_instruments) * 2 * num_levels, book_levels_path(path))
+        , m_sides(size_t(num_instruments) * 2, book_sides_path(path))
+        , m_qty(size_t(num_instruments) * 2 * num_levels)
+        , m_best(size_t(num_instruments) * 2, NO_LEVEL)
+        , m_num_levels(num_levels)
+        {
+        m_sides.user_header() = BookHeader{num_instruments, num_levels};
+        while(m_levels.size() < m_levels.capacity())
+            m_levels.emplace_back();
+        while(m_sides.size() < m_sides.capacity())
+            m_sides.emplace_back();
+        }
+
+    // Ladder covers [base_px, base_px + num_levels) on both sides
+    void set_ladder(uint32_t instrument, int64_t base_px)
+        {
+        for(size_t side = 0; side < 2; ++side)
+            {
+            auto top = m_sides.produce_begin(instrument * 2 + side);
+            top->base_px = base_px;
+            }
+        }
+
+    // Returns false for prices outside the instrument's ladder.
+    bool apply(BookMsg const& msg)
+        {
+        size_t const side_idx = msg.instrument * 2 + size_t(msg.side);
+        auto top = m_sides.produce_begin(side_idx); // side seqlock open
+        int64_t const level = msg.px - top->base_px;
+        if(level < 0 || level >= m_num_levels)
+            return false;
+        size_t const level_idx = side_idx * m_num_levels + level;
+        int64_t& qty = m_qty[level_idx];
+        bool const was_empty = qty <= 0;
+        {
+            auto lvl = m_levels.produce_begin(level_idx);
+            switch(msg.type)
+                {
+                case BookMsg::eType::ADD:    lvl->qty += msg.qty; lvl->orders += 1; break;
+                case BookMsg::eType::MODIFY: lvl->qty  = msg.qty; break;
+                case BookMsg::eType::DELETE: *lvl = BookLevel{}; break;
+                }
+            qty = lvl->qty;
+        }
+        bool const is_empty = qty <= 0;
+        top->levels_used += int(was_empty) - int(is_empty);
+        top->updates     += 1;
+        update_best(side_idx, uint32_t(level), *top);
+        return true;
+        }
+
+private:
+    static constexpr uint32_t NO_LEVEL = ~0u;
+
+    // Bids: best is the highest non-empty level, asks: the lowest.
+    void update_best(size_t side_idx, uint32_t level, BookSide& top)
+        {
+        bool const bid = 0 == side_idx % 2;
+        int64_t const* const qty = &m_qty[side_idx * m_num_levels];
+        uint32_t& best = m_best[side_idx];
+        auto const better = [bid](uint32_t lhs, uint32_t rhs)
+            {return NO_LEVEL == rhs || (bid ? lhs > rhs : lhs < rhs);};
+        if(qty[level] > 0 && better(level, best))
+            best = level;
+        else if(level == best && qty[level] <= 0)
+            {
+            // Walk away from the old best to the next non-empty level
+            best = NO_LEVEL;
+            for(uint32_t ii = level; ii < m_num_levels; bid ? --ii : ++ii)
+                if(qty[ii] > 0) {best = ii; break;}
+            }
+        top.best_level = best;
+        top.best_px    = NO_LEVEL == best ? 0 : top.base_px + best;
+        top.best_qty   = NO_LEVEL == best ? 0 : qty[best];
+        }
+
+    ShmContainerProducer<BookLevel>                               m_levels;
+    ShmContainerProducer<BookSide, uint32_t, BookHeader, 64>      m_sides;
+    std::vector<int64_t>   m_qty;   // local mirror, never read back from shm
+    std::vector<uint32_t>  m_best;
+    uint32_t               m_num_levels;
+};
+
+//==============================================================================
+class ShmOrderBookConsumer
+{
+public:
+    struct Quote
+    {
+        int64_t px;
+        int64_t qty;
+    };
+    struct Bbo
+    {
+        Quote bid;
+        Quote ask;
+    };
+
+    ShmOrderBookConsumer(uint32_t num_instruments, uint32_t num_levels, std::string const& path)
+        : m_levels(size_t(num_instruments) * 2 * num_levels, book_levels_path(path))
+        , m_sides(size_t(num_instruments) * 2, book_sides_path(path))
+        , m_num_levels(num_levels)
+        {
+        if(m_sides.user_header().num_levels != num_levels)
+            throw std::invalid_argument("order book ladder length does not match the producer's");
+        }
+
+    // Each side consistent on its own, one cache line each
+    Bbo bbo(uint32_t instrument)
+        {
+        BookSide const bid = m_sides.consume_begin(instrument * 2).get_copy();
+        BookSide const ask = m_sides.consume_begin(instrument * 2 + 1).get_copy();
+        return Bbo{{bid.best_px, bid.best_qty}, {ask.best_px, ask.best_qty}};
+        }
+
+    // Best k levels of one side, best first, as of one side version.
+    size_t top_k(uint32_t instrument, eBookSide side, Quote* out, size_t k)
+        {
+        size_t const side_idx = instrument * 2 + size_t(side);
+        bool const bid = eBookSide::BID == side;
+        auto scoped = m_sides.consume_begin(side_idx);
+        size_t count;
+        do {
+            BookSide const top = *scoped;
+            count = 0;
+            if(top.best_qty > 0)
+                for(int64_t level = top.best_level; level >= 0 && level < m_num_levels && count < k;
+                    level += bid ? -1 : 1)
+                    {
+                    BookLevel lvl;
+                    if(m_levels.try_copy(side_idx * m_num_levels + level, lvl) && lvl.qty > 0)
+                        out[count++] = Quote{top.base_px + level, lvl.qty};
+                    }
+        } while(!scoped.try_consume_commit());
+        return count;
+        }
+
+private:
+    ShmContainerConsumer<BookLevel>                               m_levels;
+    ShmContainerConsumer<BookSide, uint32_t, BookHeader, 64>      m_sides;
+    int64_t                m_num_levels;
+};
+
+//==============================================================================
+// Consumer side of compaction: follows the forwarding log so that indices
+// cached before a compaction still find their records.
+class ShmForwardingResolver
+{
+public:
+    ShmForwardingResolver(size_t log_capacity, std::string fwd_log_path)
+        : m_log(log_capacity, fwd_log_path)
+        {}
+
+    // Picks up moves logged since the last call
+    void refresh()
+        {
+        ForwardEntry entry;
+        for(; m_next < m_log.size() && m_log.try_copy(m_next, entry); ++m_next)
+            m_moves[entry.from].push_back({entry.gen, entry.to}); // gens ascending
+        }
+
+    // idx was cached in generation gen; returns where that record lives
+    // now and advances gen to the generation it is valid in.
+    size_t resolve(size_t idx, uint64_t& gen)
+        {
+        refresh();
+        for(;;)
+            {
+            auto const it = m_moves.find(idx);
+            if(it == m_moves.end())
+                return idx;
+            auto const move = std::upper_bound(it->second.begin(), it->second.end(),
+                                               std::make_pair(gen, ~uint64_t(0)));
+            if(move == it->second.end())
+                return idx;
+            gen = move->first;
+            idx = move->second;
+            }
+        }
+
+private:
+    ShmContainerConsumer<ForwardEntry>  m_log;
+    size_t                              m_next {};
+    std::unordered_map<uint64_t, std::vector<std::pair<uint64_t, uint64_t>>> m_moves;
+};
+
+//==============================================================================
+// Shared-memory B+-tree secondary index, e.g. records by strike or expiry.
+// Nodes are records of their own container, 64-byte aligned with all keys on
+// the first cache line, and refer to each other by node index rather than by
+// pointer, so any process can map the pool at any address. The single
+// producer keeps a private mirror and republishes each node it changes under
+// that node's seqlock; readers validate every node they use and never lock.
+// Splits publish the new right sibling before the left node links to it, so
+// a reader that raced a split finds the moved entries by walking the leaf
+// chain, as in a B-link tree. Erase does not rebalance.
+template<typename T_Key>
+__attribute__((target("sse4.2")))
+inline size_t simd_count_less(T_Key const* keys, size_t n, T_Key key)
+{
+    static_assert(std::is_signed<T_Key>::value && (4 == sizeof(T_Key) || 8 == sizeof(T_Key)),
+                  "index keys are int32_t or int64_t");
+    constexpr size_t LANES = 16 / sizeof(T_Key);
+    __m128i const probe = 4 == sizeof(T_Key) ? _mm_set1_epi32(int32_t(key)) : _mm_set1_epi64x(key);
+    size_t count = 0;
+    size_t ii = 0;
+    for(; ii + LANES <= n; ii += LANES)
+        {
+        __m128i const chunk = _mm_loadu_si128(reinterpret_cast<__m128i const*>(keys + ii));
+        __m128i const less  = 4 == sizeof(T_Key) ? _mm_cmpgt_epi32(probe, chunk)
+                                                 : _mm_cmpgt_epi64(probe, chunk);
+        count += __builtin_popcount(_mm_movemask_epi8(less)) / sizeof(T_Key);
+        }
+    for(; ii < n; ++ii)
+        count += keys[ii] < key;
+    return count;
+}
+
+template<typename T_Key>
+struct alignas(64) BTreeNode
+{
+    static constexpr size_t   KEYS    = (64 - 8) / sizeof(T_Key); // 14 or 7
+    static constexpr uint32_t NO_NODE = ~0u;
+
+    uint16_t count;            // keys in use
+    uint8_t  leaf;
+    uint8_t  reserved;
+    uint32_t next;             // right sibling, leaves only
+    T_Key    keys[KEYS];       // unused keys are max(), which the SIMD count never includes
+    uint64_t slots[KEYS + 1];  // inner: child nodes [0, count], leaf: record index per key
+};
+
+struct BTreeMeta // user header of the node container, zero in a new file
+{
+    std::atomic<uint32_t> root;
+    std::atomic<uint32_t> height;  // 0: no root yet
+};
+
+template<typename T_Key>
+using ShmBTreeNodesProducer = ShmContainerProducer<BTreeNode<T_Key>, uint32_t, BTreeMeta, 64>;
+template<typename T_Key>
+using ShmBTreeNodesConsumer = ShmContainerConsumer<BTreeNode<T_Key>, uint32_t, BTreeMeta, 64>;
+
+template<typename T_Key>
+class ShmBTreeIndex
+{
+public:
+    using Node = BTreeNode<T_Key>;
+
+    ShmBTreeIndex(size_t max_nodes, std::string const& nodes_file_path)
+        : m_nodes(max_nodes, nodes_file_path)
+        {
+        m_local.reserve(max_nodes);
+        if(!meta().height.load(std::memory_order_acquire))
+            {
+            m_root = alloc(true);
+            publish(m_root);
+            meta().root.store(m_root, std::memory_order_relaxed);
+            meta().height.store(1, std::memory_order_release);
+            return;
+            }
+        // Restart on an existing index: rebuild the private mirror
+        ShmBTreeNodesConsumer<T_Key> reader(max_nodes, nodes_file_path);
+        m_local.resize(m_nodes.size());
+        for(size_t ii = 0; ii < m_local.size(); ++ii)
+            if(!reader.try_copy(ii, m_local[ii]))
+                throw std::runtime_error("B+-tree node " + std::to_string(ii) + " is unreadable");
+        m_root = meta().root.load(std::memory_order_relaxed);
+        }
+
+    void insert(T_Key key, uint64_t record_index)
+        {
+        // Descend rightmost among equal keys, so duplicates append
+        struct Step {uint32_t node; size_t pos;} path[MAX_HEIGHT];
+        size_t depth = 0;
+        uint32_t idx = m_root;
+        while(!m_local[idx].leaf)
+            {
+            size_t const pos = count_less_equal(m_local[idx], key);
+            path[depth++] = Step{idx, pos};
+            idx = uint32_t(m_local[idx].slots[pos]);
+            }
+        T_Key    up_key  = key;
+        uint64_t up_slot = record_index;
+        size_t   pos     = count_less_equal(m_local[idx], key);
+        for(;;)
+            {
+            if(m_local[idx].count < Node::KEYS)
+                {
+                insert_at(m_local[idx], pos, up_key, up_slot);
+                publish(idx);
+                return;
+                }
+            uint32_t const right = alloc(m_local[idx].leaf);
+            up_key  = split_insert(m_local[idx], m_local[right], pos, up_key, up_slot);
+            up_slot = right;
+            if(m_local[idx].leaf)
+                {
+                m_local[right].next = m_local[idx].next;
+                m_local[idx].next   = right;
+                }
+            publish(right); // unreachable until the next line
+            publish(idx);
+            if(!depth)
+                {
+                uint32_t const root = alloc(false);
+                m_local[root].count    = 1;
+                m_local[root].keys[0]  = up_key;
+                m_local[root].slots[0] = idx;
+                m_local[root].slots[1] = right;
+                publish(root);
+                m_root = root;
+                meta().root.store(root, std::memory_order_release);
+                meta().height.fetch_add(1, std::memory_order_release);
+                return;
+                }
+            --depth;
+            idx = path[depth].node;
+            pos = path[depth].pos;
+            }
+        }
+
+    // Removes one (key, record_index) entry, false if there is none.
+    bool erase(T_Key key, uint64_t record_index)
+        {
+        uint32_t idx = m_root;
+        while(!m_local[idx].leaf)
+            idx = uint32_t(m_local[idx].slots[simd_count_less(m_local[idx].keys, Node::KEYS, key)]);
+        for(; Node::NO_NODE != idx; idx = m_local[idx].next)
+            {
+            Node& node = m_local[idx];
+            for(size_t ii = simd_count_less(node.keys, Node::KEYS, key); ii < node.count; ++ii)
+                {
+                if(node.keys[ii] != key)
+                    return false;
+                if(node.slots[ii] != record_index)
+                    continue;
+                std::copy(node.keys + ii + 1, node.keys + node.count, node.keys + ii);
+                std::copy(node.slots + ii + 1, node.slots + node.count, node.slots + ii);
+                node.keys[--node.count] = std::numeric_limits<T_Key>::max();
+                publish(idx);
+                return true;
+                }
+            }
+        return false;
+        }
+
+    // A record's indexed field changed
+    void update(T_Key old_key, T_Key new_key, uint64_t record_index)
+        {
+        if(old_key == new_key)
+            return;
+        erase(old_key, record_index);
+        insert(new_key, record_index);
+        }
+
+    size_t height()      {return meta().height.load(std::memory_order_relaxed);}
+    size_t nodes() const {return m_local.size();}
+
+private:
+    static constexpr size_t MAX_HEIGHT = 32;
+
+    BTreeMeta& meta() {return m_nodes.user_header();}
+
+    static size_t count_less_equal(Node const& node, T_Key key)
+        {
+        size_t pos = simd_count_less(node.keys, Node::KEYS, key);
+        while(pos < node.count && node.keys[pos] == key)
+            ++pos;
+        return pos;
+        }
+
+    // Leaves pair slots[i] with keys[i], inner nodes put the new child right of its key
+    static void insert_at(Node& node, size_t pos, T_Key key, uint64_t slot)
+        {
+        size_t const slot_pos = node.leaf ? pos : pos + 1;
+        size_t const slots    = node.leaf ? node.count : node.count + 1;
+        std::copy_backward(node.keys + pos, node.keys + node.count, node.keys + node.count + 1);
+        std::copy_backward(node.slots + slot_pos, node.slots + slots, node.slots + slots + 1);
+        node.keys[pos]       = key;
+        node.slots[slot_pos] = slot;
+        ++node.count;
+        }
+
+    // Inserts into a full node, moves the upper half to the empty right
+    // node and returns the separator for the parent.
+    static T_Key split_insert(Node& left, Node& right, size_t pos, T_Key key, uint64_t slot)
+        {
+        T_Key    keys[Node::KEYS + 1];
+        uint64_t slots[Node::KEYS + 2];
+        size_t const count = Node::KEYS + 1;
+        size_t const slot_pos = left.leaf ? pos : pos + 1;
+        size_t const nslots   = left.leaf ? count : count + 1;
+        std::copy(left.keys, left.keys + pos, keys);
+        keys[pos] = key;
+        std::copy(left.keys + pos, left.keys + Node::KEYS, keys + pos + 1);
+        std::copy(left.slots, left.slots + slot_pos, slots);
+        slots[slot_pos] = slot;
+        std::copy(left.slots + slot_pos, left.slots + nslots - 1, slots + slot_pos + 1);
+
+        size_t const half = count / 2;
+        bool const leaf = left.leaf;
+        // An inner node's middle key moves up instead of right
+        size_t const right_first = leaf ? half : half + 1;
+        T_Key const sep = keys[half];
+        std::fill(std::begin(left.keys), std::end(left.keys), std::numeric_limits<T_Key>::max());
+        left.count  = uint16_t(half);
+        right.count = uint16_t(count - right_first);
+        std::copy(keys, keys + half, left.keys);
+        std::copy(keys + right_first, keys + count, right.keys);
+        std::copy(slots, slots + half + !leaf, left.slots);
+        std::copy(slots + right_first, slots + nslots, right.slots);
+        return sep;
+        }
+
+    uint32_t alloc(bool leaf)
+        {
+        if(m_local.size() >= m_nodes.capacity())
+            throw std::length_error("B+-tree node pool is full");
+        Node node {};
+        node.leaf = leaf;
+        node.next = Node::NO_NODE;
+        std::fill(std::begin(node.keys), std::end(node.keys), std::numeric_limits<T_Key>::max());
+        m_local.push_back(node);
+        return uint32_t(m_local.size() - 1);
+        }
+
+    void publish(uint32_t idx)
+        {
+        auto prod = idx < m_nodes.size() ? m_nodes.produce_begin(idx) : m_nodes.emplace_back();
+        *prod = m_local[idx];
+        }
+
+    ShmBTreeNodesProducer<T_Key>  m_nodes;
+    std::vector<Node>             m_local; // private mirror, never read back from shm
+    uint32_t                      m_root {};
+};
+
+//==============================================================================
+template<typename T_Key>
+class ShmBTreeReader
+{
+public:
+    using Node = BTreeNode<T_Key>;
+
+    ShmBTreeReader(size_t max_nodes, std::string const& nodes_file_path)
+        : m_nodes(max_nodes, nodes_file_path)
+        {}
+
+    // Calls on_hit(key, record_index) for every entry with lo <= key <= hi,
+    // in key order. Each leaf is a consistent snapshot; entries inserted or
+    // erased while the scan runs may or may not be reported.
+    template<typename F>
+    size_t range(T_Key lo, T_Key hi, F&& on_hit)
+        {
+        uint32_t idx = lower_leaf(lo);
+        size_t hits = 0;
+        Node leaf;
+        for(; Node::NO_NODE != idx; idx = leaf.next)
+            {
+            while(!m_nodes.try_copy(idx, leaf))
+                _mm_pause();
+            for(size_t ii = simd_count_less(leaf.keys, Node::KEYS, lo); ii < leaf.count; ++ii)
+                {
+                if(leaf.keys[ii] > hi)
+                    return hits;
+                on_hit(leaf.keys[ii], leaf.slots[ii]);
+                ++hits;
+                }
+            }
+        return hits;
+        }
+
+    size_t count(T_Key lo, T_Key hi) {return range(lo, hi, [](T_Key, uint64_t) {});}
+
+private:
+    // Inner nodes are only projected: the key line and one child slot
+    uint32_t lower_leaf(T_Key key)
+        {
+        BTreeMeta& meta = m_nodes.user_header();
+        while(!meta.height.load(std::memory_order_acquire))
+            _mm_pause(); // producer still creating the root
+        uint32_t idx = meta.root.load(std::memory_order_acquire);
+        struct Step {uint64_t child; bool leaf;} step;
+        auto const descend = [key](Node const& node)
+            {return Step{node.slots[simd_count_less(node.keys, Node::KEYS, key)], bool(node.leaf)};};
+        for(;;)
+            {
+            while(!m_nodes.try_project(idx, descend, step))
+                _mm_pause();
+            if(step.leaf)
+                return idx;
+            idx = uint32_t(step.child);
+            }
+        }
+
+    ShmBTreeNodesConsumer<T_Key>  m_nodes;
+};
+
+//==============================================================================
+// Per-key back-chains over an append-only log: every record carries the
+// index of the previous record with the same key, plus a skip-back link
+// (Myers' skew-binary jump pointers), and a head table holds each key's
+// newest record. "Last k ticks of X" is then O(k), and "X as of t" is
+// O(log n) in X's own history, provided times never decrease per key.
+// Records are immutable once appended; only the key's head record is
+// rewritten, under its seqlock.
+template<typename T_Object>
+struct KeyChained
+{
+    static constexpr uint64_t NO_RECORD = ~uint64_t(0);
+
+    T_Object obj;
+    uint64_t prev;  // previous record with the same key
+    uint64_t jump;  // further back; the key's first record jumps to itself
+    uint64_t seq;   // ordinal within the key
+};
+
+struct KeyHead
+{
+    uint64_t head;  // newest record of the key
+    uint64_t count;
+};
+
+inline std::string key_heads_path(std::string const& path) {return path + ".heads";}
+
+template<typename T_Object, typename T_KeyOf> // T_KeyOf: uint32_t(T_Object const&), dense
+class ShmKeyChainProducer
+{
+public:
+    using Chained = KeyChained<T_Object>;
+
+    ShmKeyChainProducer(size_t capacity, uint32_t max_keys, std::string const& path, T_KeyOf key_of = {})
+        : m_log(capacity, path)
+        , m_heads(max_keys, key_heads_path(path))
+        , m_links(capacity, path)
+        , m_key_of(key_of)
+        {
+        while(m_heads.size() < m_heads.capacity())
+            *m_heads.emplace_back() = KeyHead{Chained::NO_RECORD, 0};
+        }
+
+    // Appends obj, links it behind its key's previous record and returns its index.
+    size_t append(T_Object const& obj)
+        {
+        uint32_t const key = m_key_of(obj);
+        if(key >= m_heads.capacity())
+            throw std::invalid_argument("key " + std::to_string(key) + " is beyond the head table");
+        auto head = m_heads.produce_begin(key); // readers of this key wait for the new head
+        Chained rec;
+        rec.obj  = obj;
+        rec.prev = head->head;
+        rec.seq  = head->count;
+        rec.jump = m_log.size();
+        if(Chained::NO_RECORD != rec.prev)
+            {
+            // Jump past the parent's jump when the two spans before it are equal
+            Link const p  = link(rec.prev);
+            Link const j  = link(p.jump);
+            Link const jj = link(j.jump);
+            rec.jump = p.seq - j.seq == j.seq - jj.seq ? j.jump : rec.prev;
+            }
+        *m_log.emplace_back() = rec;
+        head->head  = m_log.size() - 1;
+        head->count = rec.seq + 1;
+        return head->head;
+        }
+
+    size_t size() const {return m_log.size();}
+
+private:
+    struct Link
+    {
+        uint64_t jump;
+        uint64_t seq;
+    };
+    // Own records are never torn, the producer is the only writer
+    Link link(uint64_t idx) const
+        {
+        Link out;
+        m_links.try_project(idx, [](Chained const& rec) {return Link{rec.jump, rec.seq};}, out);
+        return out;
+        }
+
+    ShmContainerProducer<Chained>   m_log;
+    ShmContainerProducer<KeyHead>   m_heads;
+    ShmContainerConsumer<Chained>   m_links;  // read side of m_log
+    T_KeyOf                         m_key_of;
+};
+
+//==============================================================================
+template<typename T_Object, typename T_TimeOf> // T_TimeOf: uint64_t(T_Object const&)
+class ShmKeyChainConsumer
+{
+public:
+    using Chained = KeyChained<T_Object>;
+
+    ShmKeyChainConsumer(size_t capacity, uint32_t max_keys, std::string const& path, T_TimeOf time_of = {})
+        : m_log(capacity, path)
+        , m_heads(max_keys, key_heads_path(path))
+        , m_time_of(time_of)
+        {}
+
+    // Newest first; returns how many of the key's last k records were copied.
+    size_t latest(uint32_t key, T_Object* out, size_t k) const
+        {
+        uint64_t idx = head(key).head;
+        size_t count = 0;
+        Chained rec;
+        for(; count < k && Chained::NO_RECORD != idx; idx = rec.prev)
+            {
+            copy(idx, rec);
+            out[count++] = rec.obj;
+            }
+        return count;
+        }
+
+    // The key's last record with time <= t; false if it has none.
+    bool as_of(uint32_t key, uint64_t t, T_Object& out, uint64_t* out_index = nullptr) const
+        {
+        uint64_t idx = head(key).head;
+        if(Chained::NO_RECORD == idx)
+            return false;
+        Step cur = step(idx);
+        while(cur.time > t)
+            {
+            if(0 == cur.seq)
+                return false;
+            Step const jump = step(cur.jump);
+            if(jump.time > t)
+                {
+                idx = cur.jump;
+                cur = jump;
+                continue;
+                }
+            idx = cur.prev;
+            cur = step(idx);
+            }
+        Chained rec;
+        copy(idx, rec);
+        out = rec.obj;
+        if(out_index)
+            *out_index = idx;
+        return true;
+        }
+
+    uint64_t count(uint32_t key) const {return head(key).count;}
+
+private:
+    struct Step
+    {
+        uint64_t time;
+        uint64_t prev;
+        uint64_t jump;
+        uint64_t seq;
+    };
+    // Only the links and the time are read while searching
+    Step step(uint64_t idx) const
+        {
+        Step out;
+        auto const proj = [this](Chained const& rec)
+            {return Step{m_time_of(rec.obj), rec.prev, rec.jump, rec.seq};};
+        while(!m_log.try_project(idx, proj, out))
+            _mm_pause();
+        return out;
+        }
+    void copy(uint64_t idx, Chained& rec) const
+        {
+        while(!m_log.try_copy(idx, rec))
+            _mm_pause();
+        }
+    KeyHead head(uint32_t key) const
+        {
+        KeyHead out;
+        while(!m_heads.try_copy(key, out))
+            _mm_pause();
+        return out;
+        }
+
+    ShmContainerConsumer<Chained>   m_log;
+    ShmContainerConsumer<KeyHead>   m_heads;
+    T_TimeOf                        m_time_of;
+};
+
+//==============================================================================
+// Keyed reference data (lot size, tick size, ...) in shared memory: the
+// records in one container, and an open-addressing hash index from key to
+// record index in a second one (path + ".keys"), so every reader shares a
+// single lookup structure instead of building its own map. The producer
+// owns both and keeps a private mirror of the index. Keys are never
+// removed; an upsert of a known key rewrites its record in place. Each
+// index slot is its own seqlock record, probed with linear probing.
+struct RefKeySlot
+{
+    uint64_t key_plus_one;  // 0: empty
+    uint64_t index;         // record in the reference container
+};
+
+inline std::string ref_keys_path(std::string const& path) {return path + ".keys";}
+inline size_t ref_key_slots(size_t capacity) // power of two, at most half full
+{
+    size_t slots = 2;
+    while(slots < 2 * capacity)
+        slots *= 2;
+    return slots;
+}
+inline size_t ref_key_home(uint64_t key, size_t slots)
+    {return size_t((key * 0x9E3779B97F4A7C15ull) >> 32) & (slots - 1);}
+
+template<typename T_Ref, typename T_KeyOf> // T_KeyOf: uint64_t(T_Ref const&)
+class ShmKeyedRefProducer
+{
+public:
+    ShmKeyedRefProducer(size_t capacity, std::string const& path, T_KeyOf key_of = {})
+        : m_refs(capacity, path)
+        , m_slots(ref_key_slots(capacity), ref_keys_path(path))
+        , m_key_of(key_of)
+        , m_local(ref_key_slots(capacity))
+        {
+        ShmContainerConsumer<RefKeySlot> const existing(m_local.size(), ref_keys_path(path)); // reattach
+        for(size_t idx = 0; idx < existing.size(); ++idx)
+            existing.try_copy(idx, m_local[idx]);
+        while(m_slots.size() < m_local.size()) // every slot readable from the start
+            *m_slots.emplace_back() = RefKeySlot{};
+        }
+
+    // Returns the record index of key_of(ref)
+    size_t upsert(T_Ref const& ref)
+        {
+        uint64_t const key = m_key_of(ref);
+        size_t const mask = m_local.size() - 1;
+        size_t pos = ref_key_home(key, m_local.size());
+        for(; m_local[pos].key_plus_one; pos = (pos + 1) & mask)
+            if(m_local[pos].key_plus_one == key + 1)
+                {
+                *m_refs.produce_begin(m_local[pos].index) = ref;
+                return m_local[pos].index;
+                }
+        if(m_refs.size() == m_refs.capacity())
+            throw std::length_error("reference container is full");
+        size_t const index = m_refs.size();
+        *m_refs.emplace_back() = ref;  // the record first, then the key that finds it
+        m_local[pos] = RefKeySlot{key + 1, index};
+        *m_slots.produce_begin(pos) = m_local[pos];
+        return index;
+        }
+
+    size_t size() const {return m_refs.size();}
+
+private:
+    ShmContainerProducer<T_Ref>      m_refs;
+    ShmContainerProducer<RefKeySlot> m_slots;
+    T_KeyOf                          m_key_of;
+    std::vector<RefKeySlot>          m_local; // mirror of m_slots, never read back from shm
+};
+
+template<typename T_Ref>
+class ShmKeyedRefReader
+{
+public:
+    static constexpr uint64_t NO_RECORD = ~uint64_t(0);
+
+    ShmKeyedRefReader(size_t capacity, std::string const& path)
+        : m_refs(capacity, path)
+        , m_slots(ref_key_slots(capacity), ref_keys_path(path))
+        , m_num_slots(ref_key_slots(capacity))
+        {}
+
+    // Record index of key, or NO_RECORD
+    uint64_t find(uint64_t key) const
+        {
+        size_t const mask = m_num_slots - 1;
+        RefKeySlot slot;
+        for(size_t pos = ref_key_home(key, m_num_slots), probes = 0; probes < m_num_slots;
+            pos = (pos + 1) & mask, ++probes)
+            {
+            while(!m_slots.try_copy(pos, slot))
+                {
+                if(pos >= m_slots.size())
+                    return NO_RECORD; // producer still laying out the index
+                _mm_pause(); // being published
+                }
+            if(slot.key_plus_one == key + 1)
+                return slot.index;
+            if(!slot.key_plus_one)
+                break;
+            }
+        return NO_RECORD;
+        }
+
+    bool try_get_index(uint64_t index, T_Ref& out) const
+        {
+        while(!m_refs.try_copy(index, out))
+            {
+            if(index >= m_refs.size() || m_refs.is_erased(index))
+                return false;
+            _mm_pause();
+            }
+        return true;
+        }
+    bool try_get(uint64_t key, T_Ref& out) const
+        {
+        uint64_t const index = find(key);
+        return NO_RECORD != index && try_get_index(index, out);
+        }
+
+    void prefetch_key(uint64_t key) const {m_slots.prefetch(ref_key_home(key, m_num_slots));}
+    void prefetch_index(uint64_t index) const {m_refs.prefetch(index);}
+    size_t size() const {return m_refs.size();}
+
+private:
+    ShmContainerConsumer<T_Ref>      m_refs;
+    ShmContainerConsumer<RefKeySlot> m_slots;
+    size_t                           m_num_slots;
+};
+
+//==============================================================================
+// Streaming enrichment join: tails a tick container, looks each tick's key
+// up in a keyed reference container and appends enrich(tick, ref, out) to
+// an output container, in tick order. ref is null for unknown keys. A batch
+// goes through three passes so the misses overlap: hash and prefetch the
+// index slots, probe them and prefetch the reference records, then copy,
+// enrich and emit. Reference updates are picked up on the next tick that
+// reads them.
+template<typename T_TickConsumer, typename T_Ref, typename T_OutProducer,
+         typename T_KeyOf,   // uint64_t(T_Tick const&)
+         typename T_Enrich>  // void(T_Tick const&, T_Ref const*, T_Out&)
+class ShmEnrichJoin
+{
+public:
+    using T_Tick = typename T_TickConsumer::value_type;
+    static constexpr size_t BATCH = 256;
+
+    ShmEnrichJoin(T_TickConsumer& ticks, ShmKeyedRefReader<T_Ref> const& refs, T_OutProducer& out,
+                  T_KeyOf key_of = {}, T_Enrich enrich = {}, bool prefetch = true)
+        : m_ticks(ticks), m_refs(refs), m_out(out), m_key_of(key_of), m_enrich(enrich)
+        , m_prefetch(prefetch), m_batch(BATCH), m_keys(BATCH), m_index(BATCH)
+        {}
+
+    // Processes what is committed; returns ticks consumed.
+    size_t poll_once()
+        {
+        size_t const n = m_ticks.copy_committed(m_next, BATCH, m_batch.data());
+        for(size_t ii = 0; ii < n; ++ii)
+            {
+            m_keys[ii] = m_key_of(m_batch[ii]);
+            if(m_prefetch)
+                m_refs.prefetch_key(m_keys[ii]);
+            }
+        for(size_t ii = 0; ii < n; ++ii)
+            {
+            m_index[ii] = m_refs.find(m_keys[ii]);
+            if(m_prefetch && ShmKeyedRefReader<T_Ref>::NO_RECORD != m_index[ii])
+                m_refs.prefetch_index(m_index[ii]);
+            }
+        T_Ref ref;
+        for(size_t ii = 0; ii < n; ++ii)
+            {
+            bool const found = ShmKeyedRefReader<T_Ref>::NO_RECORD != m_index[ii]
+                            && m_refs.try_get_index(m_index[ii], ref);
+            m_misses += !found;
+            auto vptr = m_out.emplace_back();
+            m_enrich(m_batch[ii], found ? &ref : nullptr, *vptr);
+            }
+        m_next += n;
+        return n;
+        }
+
+    void run(std::atomic<bool> const& stop)
+        {
+        while(!stop.load(std::memory_order_relaxed))
+            if(!poll_once())
+                std::this_thread::yield();
+        }
+
+    uint64_t ticks_consumed() const {return m_next;}
+    uint64_t misses() const         {return m_misses;}
+
+private:
+    T_TickConsumer&                  m_ticks;
+    ShmKeyedRefReader<T_Ref> const&  m_refs;
+    T_OutProducer&                   m_out;
+    T_KeyOf                          m_key_of;
+    T_Enrich                         m_enrich;
+    bool                             m_prefetch;
+    std::vector<T_Tick>              m_batch;
+    std::vector<uint64_t>            m_keys;
+    std::vector<uint64_t>            m_index;
+    uint64_t                         m_next {};
+    uint64_t                         m_misses {};
+};
+
+//==============================================================================
+// Sampled view for UIs and monitors that want each instrument's latest value
+// every 50-250 ms rather than every tick. Over a container updated in place
+// (one record per key), each sample reads the selected records' versions
+// and copies only those that moved since the last delivery, so an
+// unchanged record costs one version load. Updates between two samples
+// are conflated into the latest consistent value. With 8/16-bit versions
+// a record that laps exactly between two samples looks unchanged.
+template<typename T_Consumer>
+class ShmSampledView
+{
+public:
+    using T_Object  = typename T_Consumer::value_type;
+    using T_Version = typename T_Consumer::version_type;
+
+    ShmSampledView(T_Consumer const& cons, std::vector<size_t> indices, uint64_t interval_ns)
+        : m_cons(cons), m_interval_ns(interval_ns)
+        {select(std::move(indices));}
+
+    // Replaces the key set; the new keys are all delivered on the next sample
+    void select(std::vector<size_t> indices)
+        {
+        m_indices = std::move(indices);
+        m_seen.assign(m_indices.size(), T_Version(0));
+        }
+
+    // Calls on_change(index, obj) for each selected record whose version
+    // moved since it was last delivered; returns how many were delivered.
+    template<typename F>
+    size_t sample(F&& on_change)
+        {
+        size_t changed = 0;
+        T_Object obj;
+        for(size_t ii = 0; ii < m_indices.size(); ++ii)
+            {
+            size_t const idx = m_indices[ii];
+            if(idx >= m_cons.size() || m_cons.version(idx) == m_seen[ii])
+                continue;
+            T_Version ver;
+            bool copied = false;
+            for(int attempt = 0; attempt < 64 && !(copied = m_cons.try_copy(idx, obj, &ver)); ++attempt)
+                {
+                if(m_cons.is_erased(idx))
+                    break;
+                _mm_pause();
+                }
+            if(copied)
+                {
+                on_change(idx, obj);
+                ++changed;
+                m_seen[ii] = ver;
+                }
+            else if(m_cons.is_erased(idx))
+                m_seen[ii] = m_cons.version(idx); // not delivered, not rechecked either
+            }
+        ++m_samples;
+        m_delivered += changed;
+        return changed;
+        }
+
+    // Samples at every interval boundary of the steady clock until stop
+    template<typename F>
+    void run(std::atomic<bool> const& stop, F&& on_change)
+        {
+        auto next = std::chrono::steady_clock::now();
+        while(!stop.load(std::memory_order_relaxed))
+            {
+            sample(on_change);
+            next += std::chrono::nanoseconds(m_interval_ns);
+            std::this_thread::sleep_until(next);
+            }
+        }
+
+    uint64_t samples() const   {return m_samples;}
+    uint64_t delivered() const {return m_delivered;}
+
+private:
+    T_Consumer const&      m_cons;
+    uint64_t               m_interval_ns;
+    std::vector<size_t>    m_indices;
+    std::vector<T_Version> m_seen;   // version last delivered, per selected record
+    uint64_t               m_samples {};
+    uint64_t               m_delivered {};
+};
+
+//==============================================================================
+// C ABI for readers without the C++ types, e.g. Python through ctypes (see
+// mex.py). A reader maps the container file read-only and takes the record
+// layout from its header, so any container can be opened by path alone.
+// Build: g++ -std=c++17 -O2 -shared -fPIC shm.cpp -o libmex.so
+// Read-only readers do not count as references of the file.
+inline uint64_t mex_load_version(ShmRecordLayout const& lay, unsigned char const* rec, uint32_t offset)
+{
+    switch(lay.version_size)
+        {
+        case 1:  return __atomic_load_n(rec + offset, __ATOMIC_ACQUIRE);
+        case 2:  return __atomic_load_n(reinterpret_cast<uint16_t const*>(rec + offset), __ATOMIC_ACQUIRE);
+        case 4:  return __atomic_load_n(reinterpret_cast<uint32_t const*>(rec + offset), __ATOMIC_ACQUIRE);
+        default: return __atomic_load_n(reinterpret_cast<uint64_t const*>(rec + offset), __ATOMIC_ACQUIRE);
+        }
+}
+
+extern "C" {
+
+struct mex_consumer
+{
+    unsigned char const*  base;
+    size_t                bytes;
+    ShmRecordLayout       layout;
+};
+
+// Returns nullptr and sets errno on failure; EPROTO: not a container file.
+mex_consumer* mex_open(char const* path)
+{
+    int const fd = ::open(path, O_RDONLY);
+    if(fd < 0)
+        return nullptr;
+    struct stat st {};
+    if(::fstat(fd, &st) || size_t(st.st_size) < sizeof(ShmRecordLayout))
+        {
+        ::close(fd);
+        errno = EPROTO;
+        return nullptr;
+        }
+    void* const mem = ::mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED | MAP_NORESERVE, fd, 0);
+    ::close(fd);
+    if(MAP_FAILED == mem)
+        return nullptr;
+    auto* const cons = new mex_consumer {static_cast<unsigned char const*>(mem), size_t(st.st_size), {}};
+    std::memcpy(&cons->layout, mem, sizeof(ShmRecordLayout));
+    ShmRecordLayout const& lay = cons->layout;
+    if(ShmRecordLayout::MAGIC != lay.magic || ShmRecordLayout::VERSION != lay.layout_version
+       || !lay.version_size || lay.version_size > 8 || (lay.version_size & (lay.version_size - 1))
+       || lay.header_size > cons->bytes)
+        {
+        ::munmap(mem, cons->bytes);
+        delete cons;
+        errno = EPROTO;
+        return nullptr;
+        }
+    return cons;
+}
+
+void mex_close(mex_consumer* cons)
+{
+    if(!cons)
+        return;
+    ::munmap((void*)cons->base, cons->bytes);
+    delete cons;
+}
+
+ShmRecordLayout const* mex_layout(mex_consumer const* cons) {return &cons->layout;}
+
+// Base of record 0, for zero-copy (unvalidated) views of the whole array
+void const* mex_records(mex_consumer const* cons) {return cons->base + cons->layout.header_size;}
+
+uint64_t mex_size(mex_consumer const* cons)
+{
+    uint64_t const size = __atomic_load_n(
+        reinterpret_cast<uint64_t const*>(cons->base + cons->layout.size_offset), __ATOMIC_ACQUIRE);
+    // The file may be shorter than the capacity the header claims
+    return std::min<uint64_t>(size, (cons->bytes - cons->layout.header_size) / cons->layout.record_stride);
+}
+
+uint64_t mex_capacity(mex_consumer const* cons)
+{
+    return __atomic_load_n(
+        reinterpret_cast<uint64_t const*>(cons->base + cons->layout.capacity_offset), __ATOMIC_RELAXED);
+}
+
+// Single attempt at a consistent copy of one payload (layout.payload_size
+// bytes). Returns 1 on success, 0 if the record is being written, unwritten
+// or erased, -1 with errno = EBADMSG on a checksum mismatch.
+int mex_try_copy(mex_consumer const* cons, uint64_t idx, void* out, uint64_t* out_version)
+{
+    ShmRecordLayout const& lay = cons->layout;
+    if(idx >= mex_size(cons))
+        return 0;
+    unsigned char const* const rec = cons->base + lay.header_size + idx * lay.record_stride;
+    uint64_t const tombstone = uint64_t(1) << (8 * lay.version_size - 1);
+    auto const* const epoch_at = reinterpret_cast<uint64_t const*>(cons->base + lay.epoch_offset);
+    bool const laps = lay.version_size < 4;
+    uint64_t const epoch = laps ? __atomic_load_n(epoch_at, __ATOMIC_ACQUIRE) : 0;
+    uint64_t const ver = mex_load_version(lay, rec, lay.version_a_offset);
+    if(0 == ver || (ver & tombstone))
+        return 0;
+    std::memcpy(out, rec + lay.payload_offset, lay.payload_size);
+    uint32_t crc = 0;
+    bool const checksummed = lay.flags & ShmRecordLayout::CHECKSUMMED;
+    if(checksummed)
+        std::memcpy(&crc, rec + lay.crc_offset, sizeof(crc));
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if(mex_load_version(lay, rec, lay.version_b_offset) != ver
+       || (laps && __atomic_load_n(epoch_at, __ATOMIC_ACQUIRE) != epoch))
+        return 0;
+    if(checksummed && crc != crc32c(uint32_t(ver), out, lay.payload_size))
+        {
+        errno = EBADMSG;
+        return -1;
+        }
+    if(out_version)
+        *out_version = ver;
+    return 1;
+}
+
+// Validated bulk copy of payloads [first, first + max_count), packed at
+// payload_size. Like copy_committed(): stops at the first record that is
+// not readable after a retry, erased records come out zeroed. out_versions
+// may be null. Returns the number of records copied.
+uint64_t mex_copy_committed(mex_consumer const* cons, uint64_t first, uint64_t max_count,
+                            void* out, uint64_t* out_versions)
+{
+    ShmRecordLayout const& lay = cons->layout;
+    uint64_t const last = std::min(first + max_count, mex_size(cons));
+    uint64_t const tombstone = uint64_t(1) << (8 * lay.version_size - 1);
+    auto* const dst = static_cast<unsigned char*>(out);
+    uint64_t idx = first;
+    for(; idx < last; ++idx)
+        {
+        unsigned char* const to = dst + (idx - first) * lay.payload_size;
+        uint64_t ver = 0;
+        int rc = mex_try_copy(cons, idx, to, &ver);
+        if(0 == rc)
+            rc = mex_try_copy(cons, idx, to, &ver);
+        if(rc < 0)
+            break;
+        if(0 == rc)
+            {
+            unsigned char const* const rec = cons->base + lay.header_size + idx * lay.record_stride;
+            uint64_t const raw = mex_load_version(lay, rec, lay.version_a_offset);
+            if(!(raw & tombstone))
+                break;
+            std::memset(to, 0, lay.payload_size);
+            ver = raw;
+            }
+        if(out_versions)
+            out_versions[idx - first] = ver;
+        }
+    return idx - first;
+}
+
+} // extern "C"
+
+//==============================================================================
+// Hardware counters for the benchmarks, via perf_event_open(2), user space
+// only and this thread only. Each counter is opened on its own so a missing
+// event (e.g. in a VM) costs only that column; without permission
+// (perf_event_paranoid, seccomp) all columns read as unavailable and the
+// benchmarks still run. HITM has no generic event: the default is the Intel
+// MEM_LOAD_L3_HIT_RETIRED.XSNP_HITM raw code, override with
+// MEX_PERF_HITM_RAW=<hex> or set it to 0 to skip.
+class PerfCounters
+{
+public:
+    enum eCounter { INSTRUCTIONS, LLC_MISSES, DTLB_MISSES, HITM, NUM_COUNTERS };
+    struct Sample
+    {
+        double  value[NUM_COUNTERS] {};
+        bool    valid[NUM_COUNTERS] {};
+    };
+
+    PerfCounters()
+        {
+        auto const cache = [](uint64_t cache, uint64_t result)
+            {return cache | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (result << 16);};
+        open(INSTRUCTIONS, PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+        open(LLC_MISSES,   PERF_TYPE_HW_CACHE, cache(PERF_COUNT_HW_CACHE_LL, PERF_COUNT_HW_CACHE_RESULT_MISS));
+        open(DTLB_MISSES,  PERF_TYPE_HW_CACHE, cache(PERF_COUNT_HW_CACHE_DTLB, PERF_COUNT_HW_CACHE_RESULT_MISS));
+        char const* const hitm = ::getenv("MEX_PERF_HITM_RAW");
+        uint64_t const hitm_raw = hitm ? strtoull(hitm, nullptr, 16) : 0x04d2;
+        if(hitm_raw)
+            open(HITM, PERF_TYPE_RAW, hitm_raw);
+        }
+    ~PerfCounters()
+        {
+        for(int fd : m_fd)
+            if(fd >= 0)
+                ::close(fd);
+        }
+    PerfCounters(PerfCounters const&) = delete;
+    PerfCounters& operator=(PerfCounters const&) = delete;
+
+    bool available() const
+        {return std::any_of(std::begin(m_fd), std::end(m_fd), [](int fd) {return fd >= 0;});}
+
+    void start()
+        {
+        for(int fd : m_fd)
+            if(fd >= 0)
+                {
+                ::ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+                ::ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+                }
+        }
+    // Scaled up if the kernel had to multiplex the counters
+    Sample stop()
+        {
+        Sample out;
+        for(size_t ii = 0; ii < NUM_COUNTERS; ++ii)
+            {
+            if(m_fd[ii] < 0)
+                continue;
+            ::ioctl(m_fd[ii], PERF_EVENT_IOC_DISABLE, 0);
+            uint64_t buf[3]; // value, time enabled, time running
+            if(::read(m_fd[ii], buf, sizeof(buf)) != sizeof(buf) || !buf[2])
+                continue;
+            out.value[ii] = double(buf[0]) * buf[1] / buf[2];
+            out.valid[ii] = true;
+            }
+        return out;
+        }
+
+    static char const* name(eCounter counter)
+        {
+        static char const* const names[NUM_COUNTERS] = {"instr", "LLC-miss", "dTLB-miss", "HITM"};
+        return names[counter];
+        }
+
+private:
+    void open(eCounter counter, uint32_t type, uint64_t config)
+        {
+        perf_event_attr attr {};
+        attr.size           = sizeof(attr);
+        attr.type           = type;
+        attr.config         = config;
+        attr.disabled       = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv     = 1;
+        attr.read_format    = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        m_fd[counter] = int(::syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+        }
+
+    int m_fd[NUM_COUNTERS] = {-1, -1, -1, -1};
+};
+
+// Runs body once and prints ns and counter events per operation.
+template<typename F>
+void bench_case(char const* name, size_t ops, F&& body)
+{
+    thread_local PerfCounters counters; // counts the calling thread
+    counters.start();
+    uint64_t const t0 = steady_now_ns();
+    body();
+    uint64_t const elapsed_ns = steady_now_ns() - t0;
+    PerfCounters::Sample const sample = counters.stop();
+    printf("%-24s %8.2f ns/op", name, double(elapsed_ns) / ops);
+    for(size_t ii = 0; ii < PerfCounters::NUM_COUNTERS; ++ii)
+        {
+        char const* const counter = PerfCounters::name(PerfCounters::eCounter(ii));
+        if(sample.valid[ii])
+            printf("  %s %7.3f", counter, sample.value[ii] / ops);
+        else
+            printf("  %s %7s", counter, "n/a");
+        }
+    printf("\n");
+}
+
+//==============================================================================
+// Seqlock torture run. A producer keeps rewriting a few hot records with
+// self-checking payloads: every word holds the record's write count, which
+// also fixes the version the record must carry. Readers copy them through
+// try_copy() and through consume_begin()/try_consume_commit() and verify
+// every copy the container accepted. The writer is stalled in the middle
+// of its critical section, by sleeping between the two halves of a payload
+// and by SIGUSR1 from a preempter thread whose handler spins. Any accepted
+// torn read fails the run.
+
+// Log-linear histogram, 8 buckets per power of two (12.5% resolution)
+struct LogHistogram
+{
+    static constexpr int SUB = 3;
+    uint64_t counts[64 << SUB] {};
+    uint64_t total {};
+    uint64_t max {};
+
+    void add(uint64_t value)
+        {
+        ++counts[bucket(value)];
+        ++total;
+        max = std::max(max, value);
+        }
+    void merge(LogHistogram const& other)
+        {
+        for(size_t ii = 0; ii < std::size(counts); ++ii)
+            counts[ii] += other.counts[ii];
+        total += other.total;
+        max = std::max(max, other.max);
+        }
+    // Lower edge of the bucket holding the p-th value
+    uint64_t percentile(double p) const
+        {
+        uint64_t const rank = total ? uint64_t(p * double(total - 1)) : 0;
+        uint64_t seen = 0;
+        for(size_t ii = 0; ii < std::size(counts); ++ii)
+            if((seen += counts[ii]) > rank)
+                return std::min(lower_edge(ii), max);
+        return max;
+        }
+
+    static size_t bucket(uint64_t value)
+        {
+        if(value < (1u << SUB))
+            return size_t(value);
+        int const msb = 63 - __builtin_clzll(value);
+        return (size_t(msb - SUB + 1) << SUB) | size_t((value >> (msb - SUB)) & ((1u << SUB) - 1));
+        }
+    static uint64_t lower_edge(size_t idx)
+        {
+        if(idx < (1u << SUB))
+            return idx;
+        int const msb = int(idx >> SUB) + SUB - 1;
+        return uint64_t((1u << SUB) | (idx & ((1u << SUB) - 1))) << (msb - SUB);
+        }
+};
+
+struct TortureConfig
+{
+    size_t   records          = 16;    // few, so readers keep meeting the writer
+    size_t   readers          = 3;
+    uint32_t seconds          = 2;
+    uint32_t stall_every      = 1000;  // writes between mid-write sleeps, 0: never
+    uint32_t stall_us         = 50;
+    uint32_t signal_period_us = 200;   // SIGUSR1 to the writer, 0: none
+    uint32_t signal_spin_us   = 20;    // the handler holds the writer this long
+};
+
+struct TortureReport
+{
+    uint64_t     writes {};
+    uint64_t     reads {};
+    uint64_t     torn {};        // accepted copies that failed verification
+    uint64_t     stalls {};
+    uint64_t     signals {};
+    LogHistogram retries;        // rejected attempts before each accepted copy
+    LogHistogram latency_ns;     // first attempt to accepted copy
+    bool passed() const {return 0 == torn;}
+};
+
+struct TorturePayload
+{
+    uint64_t word[8]; // all equal to the record's write count
+};
+
+inline std::atomic<uint32_t> g_torture_spin_us {};
+inline void torture_on_signal(int)
+{
+    // clock_gettime() is async-signal-safe
+    uint64_t const until = steady_now_ns() + 1000ull * g_torture_spin_us.load(std::memory_order_relaxed);
+    while(steady_now_ns() < until)
+        _mm_pause();
+}
+
+template<typename T_Version = uint32_t>
+TortureReport run_torture(char const* file_path, TortureConfig const& cfg = {})
+{
+    ::unlink(file_path);
+    ShmContainerProducer<TorturePayload, T_Version> prod(cfg.records, file_path);
+    ShmContainerConsumer<TorturePayload, T_Version> cons(cfg.records, file_path);
+    for(size_t ii = 0; ii < cfg.records; ++ii)
+        *prod.emplace_back() = TorturePayload{};
+
+    // Write count n is stored with version n % lap + 1, versions wrap to 1
+    uint64_t const lap = uint64_t(T_Version(~T_Version(0))) >> 1;
+    auto const intact = [lap](TorturePayload const& obj, uint64_t ver)
+        {
+        for(uint64_t word : obj.word)
+            if(word != obj.word[0])
+                return false;
+        return !ver || ver == obj.word[0] % lap + 1;
+        };
+
+    TortureReport report;
+    std::atomic<bool> done {false};
+    std::vector<TortureReport> per_reader(cfg.readers);
+    std::vector<std::thread> readers;
+    for(size_t rr = 0; rr < cfg.readers; ++rr)
+        readers.emplace_back([&, rr]
+            {
+            TortureReport& mine = per_reader[rr];
+            uint64_t rng = 0x2545F4914F6CDD1Dull + rr;
+            TorturePayload obj;
+            while(!done.load(std::memory_order_relaxed))
+                {
+                rng ^= rng << 13; rng ^= rng >> 7; rng ^= rng << 17;
+                size_t const idx = rng % cfg.records;
+                uint64_t attempts = 0;
+                T_Version ver = 0;
+                uint64_t const t0 = steady_now_ns();
+                if(rng & (1ull << 32))
+                    {
+                    while(!cons.try_copy(idx, obj, &ver))
+                        ++attempts;
+                    }
+                else
+                    {
+                    auto rec = cons.consume_begin(idx);
+                    for(;; ++attempts)
+                        {
+                        std::memcpy(&obj, rec.get(), sizeof(obj));
+                        if(rec.try_consume_commit())
+                            break;
+                        }
+                    }
+                mine.latency_ns.add(steady_now_ns() - t0);
+                mine.retries.add(attempts);
+                ++mine.reads;
+                if(!intact(obj, ver))
+                    {
+                    if(!mine.torn++)
+                        fprintf(stderr, "torn read of record %zu: words %llx .. %llx, version %llu\n", idx,
+                                (unsigned long long)obj.word[0], (unsigned long long)obj.word[7],
+                                (unsigned long long)ver);
+                    }
+                }
+            });
+
+    struct sigaction on_usr1 {}, prev_usr1 {};
+    on_usr1.sa_handler = torture_on_signal;
+    on_usr1.sa_flags   = SA_RESTART;
+    g_torture_spin_us  = cfg.signal_spin_us;
+    ::sigaction(SIGUSR1, &on_usr1, &prev_usr1);
+    pthread_t const writer = ::pthread_self();
+    std::atomic<bool> writing {true};
+    std::thread preempter([&]
+        {
+        while(cfg.signal_period_us && writing.load(std::memory_order_relaxed))
+            {
+            std::this_thread::sleep_for(std::chrono::microseconds(cfg.signal_period_us));
+            ::pthread_kill(writer, SIGUSR1);
+            ++report.signals;
+            }
+        });
+
+    std::vector<uint64_t> write_count(cfg.records);
+    uint64_t const deadline = steady_now_ns() + cfg.seconds * 1'000'000'000ull;
+    for(uint64_t ww = 1; 0 != (ww & 1023) || steady_now_ns() < deadline; ++ww)
+        {
+        size_t const idx = ww % cfg.records;
+        uint64_t const n = ++write_count[idx];
+        auto vptr = prod.produce_begin(idx);
+        TorturePayload* const obj = vptr.get();
+        for(size_t ii = 0; ii < 4; ++ii)
+            obj->word[ii] = n;
+        std::atomic_signal_fence(std::memory_order_seq_cst); // keep the halves apart
+        if(cfg.stall_every && 0 == ww % cfg.stall_every)
+            {
+            std::this_thread::sleep_for(std::chrono::microseconds(cfg.stall_us));
+            ++report.stalls;
+            }
+        for(size_t ii = 4; ii < 8; ++ii)
+            obj->word[ii] = n;
+        ++report.writes;
+        }
+    writing = false;
+    preempter.join();
+    ::sigaction(SIGUSR1, &prev_usr1, nullptr);
+    done = true;
+    for(auto& reader : readers)
+        reader.join();
+    for(auto const& mine : per_reader)
+        {
+        report.reads += mine.reads;
+        report.torn  += mine.torn;
+        report.retries.merge(mine.retries);
+        report.latency_ns.merge(mine.latency_ns);
+        }
+    ::unlink(file_path);
+    return report;
+}
+
+//==============================================================================
+// Query DSL: expression templates over T_Object fields. A query is a type,
+// so filter, projections and aggregates inline into one fused pass over
+// validated batches from copy_committed():
+//   auto const tight = field<&NseTicker::bid_qx> > 100u
+//                   && field<&NseTicker::ask_px> - field<&NseTicker::bid_px> < 5u;
+//   uint64_t n = ShmQuery(cons).where(tight).count();
+//   auto [cnt, vol] = ShmQuery(cons).where(tight).aggregate(count_of(), sum_of(field<&NseTicker::bid_qx>));
+// && || and ! evaluate both sides, branch-free, so the pass vectorizes.
+// Operators follow C++ arithmetic: unsigned fields subtract modulo 2^N.
+template<typename T, typename = void>
+struct IsQueryExpr : std::false_type {};
+template<typename T>
+struct IsQueryExpr<T, std::void_t<typename T::query_expr_tag>> : std::true_type {};
+
+template<auto A_Member>
+struct FieldRef
+{
+    using query_expr_tag = void;
+    template<typename T_Object>
+    auto operator()(T_Object const& obj) const {return obj.*A_Member;}
+};
+template<auto A_Member>
+constexpr FieldRef<A_Member> field {};
+
+template<typename T>
+struct QueryLiteral
+{
+    using query_expr_tag = void;
+    T value;
+    template<typename T_Object>
+    T operator()(T_Object const&) const {return value;}
+};
+
+template<typename T_Op, typename L, typename R>
+struct QueryBinary
+{
+    using query_expr_tag = void;
+    L lhs;
+    R rhs;
+    template<typename T_Object>
+    auto operator()(T_Object const& obj) const {return T_Op{}(lhs(obj), rhs(obj));}
+};
+
+template<typename E>
+struct QueryNot
+{
+    using query_expr_tag = void;
+    E expr;
+    template<typename T_Object>
+    bool operator()(T_Object const& obj) const {return !expr(obj);}
+};
+
+struct QueryAllOf {bool operator()(bool lhs, bool rhs) const {return lhs & rhs;}};
+struct QueryAnyOf {bool operator()(bool lhs, bool rhs) const {return lhs | rhs;}};
+
+template<typename T>
+constexpr auto as_query_expr(T const& value)
+{
+    if constexpr(IsQueryExpr<T>::value)
+        return value;
+    else
+        return QueryLiteral<T>{value};
+}
+
+#define MEX_QUERY_OPERATOR(OP, FUNCTOR)                                                   \
+    template<typename L, typename R,                                                      \
+             typename = std::enable_if_t<IsQueryExpr<L>::value || IsQueryExpr<R>::value>> \
+    constexpr auto operator OP(L const& lhs, R const& rhs)                                \
+        {                                                                                 \
+        return QueryBinary<FUNCTOR, decltype(as_query_expr(lhs)), decltype(as_query_expr(rhs))> \
+            {as_query_expr(lhs), as_query_expr(rhs)};                                     \
+        }
+MEX_QUERY_OPERATOR(+,  std::plus<>)
+MEX_QUERY_OPERATOR(-,  std::minus<>)
+MEX_QUERY_OPERATOR(*,  std::multiplies<>)
+MEX_QUERY_OPERATOR(/,  std::divides<>)
+MEX_QUERY_OPERATOR(%,  std::modulus<>)
+MEX_QUERY_OPERATOR(<,  std::less<>)
+MEX_QUERY_OPERATOR(<=, std::less_equal<>)
+MEX_QUERY_OPERATOR(>,  std::greater<>)
+MEX_QUERY_OPERATOR(>=, std::greater_equal<>)
+MEX_QUERY_OPERATOR(==, std::equal_to<>)
+MEX_QUERY_OPERATOR(!=, std::not_equal_to<>)
+MEX_QUERY_OPERATOR(&&, QueryAllOf)
+MEX_QUERY_OPERATOR(||, QueryAnyOf)
+#undef MEX_QUERY_OPERATOR
+
+template<typename E, typename = std::enable_if_t<IsQueryExpr<E>::value>>
+constexpr QueryNot<E> operator!(E const& expr) {return {expr};}
+
+// Aggregates. Sums widen to 64 bits (double for floating point); min/max
+// of no records are numeric_limits max/lowest.
+struct CountOf {};
+template<typename E> struct SumOf {E expr;};
+template<typename E> struct MinOf {E expr;};
+template<typename E> struct MaxOf {E expr;};
+inline CountOf count_of() {return {};}
+template<typename E> SumOf<E> sum_of(E expr) {return {expr};}
+template<typename E> MinOf<E> min_of(E expr) {return {expr};}
+template<typename E> MaxOf<E> max_of(E expr) {return {expr};}
+
+template<typename T_Object, typename T_Agg>
+struct AggState;
+
+template<typename T_Object>
+struct AggState<T_Object, CountOf>
+{
+    uint64_t acc {};
+    explicit AggState(CountOf) {}
+    void add(bool keep, T_Object const&) {acc += keep;}
+    uint64_t result() const {return acc;}
+};
+
+template<typename T_Object, typename E>
+struct AggState<T_Object, SumOf<E>>
+{
+    using value_t = decltype(std::declval<E const&>()(std::declval<T_Object const&>()));
+    using acc_t   = std::conditional_t<std::is_floating_point<value_t>::value, double,
+                    std::conditional_t<std::is_signed<value_t>::value, int64_t, uint64_t>>;
+    E     expr;
+    acc_t acc {};
+    explicit AggState(SumOf<E> agg) : expr(agg.expr) {}
+    void add(bool keep, T_Object const& obj) {acc += keep ? acc_t(expr(obj)) : acc_t(0);}
+    acc_t result() const {return acc;}
+};
+
+template<typename T_Object, typename E, bool A_Max>
+struct ExtremumState
+{
+    using value_t = std::decay_t<decltype(std::declval<E const&>()(std::declval<T_Object const&>()))>;
+    E       expr;
+    value_t acc {A_Max ? std::numeric_limits<value_t>::lowest() : std::numeric_limits<value_t>::max()};
+    explicit ExtremumState(E ee) : expr(ee) {}
+    void add(bool keep, T_Object const& obj)
+        {
+        value_t const val = expr(obj);
+        acc = keep && (A_Max ? acc < val : val < acc) ? val : acc;
+        }
+    value_t result() const {return acc;}
+};
+template<typename T_Object, typename E>
+struct AggState<T_Object, MinOf<E>> : ExtremumState<T_Object, E, false>
+{
+    explicit AggState(MinOf<E> agg) : ExtremumState<T_Object, E, false>(agg.expr) {}
+};
+template<typename T_Object, typename E>
+struct AggState<T_Object, MaxOf<E>> : ExtremumState<T_Object, E, true>
+{
+    explicit AggState(MaxOf<E> agg) : ExtremumState<T_Object, E, true>(agg.expr) {}
+};
+
+// A filtered range of a consumer. Terminal calls (count, aggregate,
+// project, group_by) each make one pass; records being written when the
+// pass reaches them end it, like copy_committed(), erased ones read as
+// T_Object{} and are seen by the filter.
+template<typename T_Consumer, typename T_Pred = QueryLiteral<bool>>
+class ShmQuery
+{
+public:
+    using T_Object = typename T_Consumer::value_type;
+    static constexpr size_t BATCH = 256;
+
+    explicit ShmQuery(T_Consumer const& cons, T_Pred pred = {true},
+                      size_t first = 0, size_t last = ~size_t(0))
+        : m_cons(&cons), m_pred(pred), m_first(first), m_last(last)
+        {}
+
+    template<typename P>
+    auto where(P const& pred) const
+        {
+        auto const both = m_pred && as_query_expr(pred);
+        return ShmQuery<T_Consumer, decltype(both)>(*m_cons, both, m_first, m_last);
+        }
+    ShmQuery range(size_t first, size_t last) const {return ShmQuery(*m_cons, m_pred, first, last);}
+
+    uint64_t count() const {return std::get<0>(aggregate(count_of()));}
+    template<typename E> auto sum(E expr) const {return std::get<0>(aggregate(sum_of(expr)));}
+    template<typename E> auto min(E expr) const {return std::get<0>(aggregate(min_of(expr)));}
+    template<typename E> auto max(E expr) const {return std::get<0>(aggregate(max_of(expr)));}
+
+    // Several aggregates in one pass, results as a tuple in argument order
+    template<typename... T_Aggs>
+    auto aggregate(T_Aggs... aggs) const
+        {
+        std::tuple<AggState<T_Object, T_Aggs>...> states {AggState<T_Object, T_Aggs>(aggs)...};
+        for_each_batch([&](T_Object const* batch, size_t count)
+            {
+            for(size_t ii = 0; ii < count; ++ii)
+                {
+                bool const keep = m_pred(batch[ii]);
+                std::apply([&](auto&... state) {(state.add(keep, batch[ii]), ...);}, states);
+                }
+            });
+        return std::apply([](auto const&... state) {return std::make_tuple(state.result()...);}, states);
+        }
+
+    // Appends expr(obj) of the matching records to out
+    template<typename E, typename T_Value>
+    void project(E expr, std::vector<T_Value>& out) const
+        {
+        for_each_batch([&](T_Object const* batch, size_t count)
+            {
+            size_t kept = out.size();
+            out.resize(kept + count);
+            for(size_t ii = 0; ii < count; ++ii)
+                {
+                out[kept] = T_Value(expr(batch[ii])); // written always, kept if matched
+                kept += m_pred(batch[ii]);
+                }
+            out.resize(kept);
+            });
+        }
+
+    // Aggregates per distinct key(obj) among the matching records
+    template<typename K, typename... T_Aggs>
+    auto group_by(K key, T_Aggs... aggs) const
+        {
+        using key_t   = std::decay_t<decltype(key(std::declval<T_Object const&>()))>;
+        using state_t = std::tuple<AggState<T_Object, T_Aggs>...>;
+        std::unordered_map<key_t, state_t> groups;
+        for_each_batch([&](T_Object const* batch, size_t count)
+            {
+            for(size_t ii = 0; ii < count; ++ii)
+                {
+                if(!m_pred(batch[ii]))
+                    continue;
+                auto& group = groups.try_emplace(key(batch[ii]), AggState<T_Object, T_Aggs>(aggs)...).first->second;
+                std::apply([&](auto&... state) {(state.add(true, batch[ii]), ...);}, group);
+                }
+            });
+        std::unordered_map<key_t, std::tuple<decltype(AggState<T_Object, T_Aggs>(aggs).result())...>> out;
+        for(auto const& [group, state] : groups)
+            out.emplace(group, std::apply([](auto const&... st) {return std::make_tuple(st.result()...);}, state));
+        return out;
+        }
+
+private:
+    template<typename F>
+    void for_each_batch(F&& on_batch) const
+        {
+        std::vector<T_Object> batch(BATCH);
+        size_t const last = std::min(m_last, m_cons->size());
+        for(size_t first = m_first; first < last; )
+            {
+            size_t const got = m_cons->copy_committed(first, std::min(BATCH, last - first), batch.data());
+            if(!got)
+                break;
+            on_batch(batch.data(), got);
+            first += got;
+            }
+        }
+
+    T_Consumer const* m_cons;
+    T_Pred            m_pred;
+    size_t            m_first;
+    size_t            m_last;
+};
+
+//==============================================================================
+
+// Example contained object
+struct NseTicker
+{
+    uint32_t ask_px;
+    uint32_t ask_qx;
+    uint32_t bid_px;
+    uint32_t bid_qx;
+};
+template<> struct ShmFields<NseTicker>
+    : FieldList<&NseTicker::ask_px, &NseTicker::ask_qx, &NseTicker::bid_px, &NseTicker::bid_qx> {};
+
+void example_producer()
+{
+    ShmContainerProducer<NseTicker> shm_container(1000, "/tmp/nse_tickers.shm");
+
+    // Get a "versioned pointer"
+    auto vptr = shm_container.emplace_back();
+
+    // Update the object in any way you want (not atomically),
+    // but be quick because consumers will keep retrying their read
+    // until vptr gets out of scope or vptr.produce_commit() is called.
+    vptr->bid_px = 39000;
+    vptr->ask_px = 41000;
+    vptr->bid_qx = 55;
+    vptr->ask_qx = 77;
+
+    // optional. Will automatically be called when vptr gets out of scope anyway
+    vptr.produce_commit();
+
+    // Now consumers will see the updated version only
+}
+
+void example_consumer()
+{
+    // Consumers "connect" to the shared memory by passing in the file path.
+    ShmContainerConsumer<NseTicker> shm_container(1000, "/tmp/nse_tickers.shm");
+
+    // The "versioned pointer" makes sure you can only do consistent reads.
+    // Here we are beginning a read of object [0] in the container.
+    auto vptr = shm_container.consume_begin(0);
+    NseTicker const ticker = vptr.get_copy();
+
+}
+
+// Loopback replication with a throughput and latency report.
+void example_replication_loopback()
+{
+    size_t const N = 5'000'000;
+    ShmContainerProducer<NseTicker> source(N, "/dev/shm/repl_src.shm");
+    ShmContainerConsumer<NseTicker> tail(N, "/dev/shm/repl_src.shm");
+    ShmContainerProducer<NseTicker> mirror(N, "/dev/shm/repl_dst.shm");
+
+    ReplicationConfig cfg;
+    std::atomic<bool> stop {false};
+    ShmReplicationSender sender(tail, "127.0.0.1", 15051, cfg);
+    std::thread send_thread([&]{ sender.run(stop); });
+    ShmReplicationReceiver receiver(mirror, "127.0.0.1", 15051, cfg);
+    std::thread recv_thread([&]{ receiver.run(stop); });
+
+    uint64_t const t0 = steady_now_ns();
+    for(uint32_t ii = 0; ii < N; ++ii)
+        {
+        auto vptr = source.emplace_back();
+        *vptr = NseTicker{ii, ii, ii, ii};
+        }
+    while(receiver.expected_index() < N)
+        std::this_thread::yield();
+    uint64_t const elapsed_ns = steady_now_ns() - t0;
+    stop = true;
+    send_thread.join();
+    recv_thread.join();
+
+    auto lat = receiver.stats().latency_ns;
+    std::sort(lat.begin(), lat.end());
+    auto pct = [&](double p) {return lat.empty() ? 0u : lat[size_t(p * (lat.size() - 1))];};
+    printf("replicated %zu records in %llu batches: %.1f M rec/s, %.1f MB/s\n"
+           "batch latency ns: p50 %u  p99 %u  max %u\n",
+           N, (unsigned long long)receiver.stats().batches,
+           N * 1e3 / elapsed_ns, receiver.stats().bytes * 1e3 / elapsed_ns,
+           pct(0.5), pct(0.99), pct(1.0));
+}
+
+// Loopback multicast with 1% injected packet loss, recovered over TCP.
+void example_multicast_loopback()
+{
+    size_t const N = 1'000'000;
+    ShmContainerProducer<NseTicker> source(N, "/dev/shm/mcast_src.shm");
+    ShmContainerConsumer<NseTicker> tail(N, "/dev/shm/mcast_src.shm");
+    ShmContainerProducer<NseTicker> mirror(N, "/dev/shm/mcast_dst.shm");
+
+    MulticastConfig cfg;
+    cfg.inject_loss = 0.01;
+    std::atomic<bool> stop {false};
+    ShmSnapshotServer snapshots(tail, "127.0.0.1", 15053);
+    ShmMulticastSubscriber subscriber(mirror, "127.0.0.1", 15053, cfg);
+    ShmMulticastPublisher publisher(tail, cfg);
+    std::thread snap_thread([&]{ snapshots.run(stop); });
+    std::thread sub_thread([&]{ subscriber.run(stop); });
+
+    for(uint32_t ii = 0; ii < N; ++ii)
+        {
+        auto vptr = source.emplace_back();
+        *vptr = NseTicker{ii, ii, ii, ii};
+        if(ii % 1024 == 0)
+            publisher.poll_once();
+        }
+    while(subscriber.next_index() < N)
+        publisher.poll_once(), std::this_thread::yield();
+    stop = true;
+    sub_thread.join();
+    snap_thread.join();
+
+    auto const& st = subscriber.stats();
+    printf("multicast: %llu datagrams, %llu dropped, %llu seq gaps, "
+           "%llu records recovered over %llu TCP requests\n",
+           (unsigned long long)st.datagrams, (unsigned long long)st.injected_drops,
+           (unsigned long long)st.seq_gaps, (unsigned long long)st.recovered_records,
+           (unsigned long long)snapshots.ranges_served());
+}
+
+// Recorder throughput: drain a pre-filled container into a journal.
+void example_journal_recorder(char const* journal_path = "/tmp/nse_tickers.journal")
+{
+    size_t const N = 20'000'000;
+    ShmContainerProducer<NseTicker> source(N, "/dev/shm/journal_src.shm");
+    ShmContainerConsumer<NseTicker> tail(N, "/dev/shm/journal_src.shm");
+    for(uint32_t ii = 0; ii < N; ++ii)
+        {
+        auto vptr = source.emplace_back();
+        *vptr = NseTicker{ii, ii, ii, ii};
+        }
+
+    ShmJournalRecorder recorder(tail, journal_path);
+    std::atomic<bool> stop {false};
+    uint64_t const t0 = steady_now_ns();
+    std::thread rec_thread([&]{ recorder.run(stop); });
+    while(recorder.written_index() < N)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    uint64_t const elapsed_ns = steady_now_ns() - t0;
+    stop = true;
+    rec_thread.join();
+
+    printf("journal%s: %.1f M rec/s, %.0f MB/s, durable up to %llu, lag %zu\n",
+           recorder.using_o_direct() ? " (O_DIRECT)" : "",
+           N * 1e3 / elapsed_ns, N * sizeof(NseTicker) * 1e3 / elapsed_ns,
+           (unsigned long long)recorder.durable_index(), recorder.lag_records());
+}
+
+// CRC32C cost per record: produce and consume with and without checksums.
+template<bool A_Checksum>
+void bench_checksum_cost(char const* file_path)
+{
+    size_t const N = 10'000'000;
+    ::unlink(file_path);
+    ShmContainerProducer<NseTicker, uint32_t, NoHeaderInfo, 4, A_Checksum> prod(N, file_path);
+    ShmContainerConsumer<NseTicker, uint32_t, NoHeaderInfo, 4, A_Checksum> cons(N, file_path);
+
+    bench_case(A_Checksum ? "crc32c produce" : "plain produce", N, [&]
+        {
+        for(uint32_t ii = 0; ii < N; ++ii)
+            {
+            auto vptr = prod.emplace_back();
+            *vptr = NseTicker{ii, ii, ii, ii};
+            }
+        });
+    uint64_t sum = 0;
+    bench_case(A_Checksum ? "crc32c checked consume" : "plain consume", N, [&]
+        {
+        NseTicker copy;
+        for(size_t ii = 0; ii < N; ++ii)
+            if(cons.try_copy(ii, copy))
+                sum += copy.bid_px;
+        });
+    printf("(sum %llu)\n", (unsigned long long)sum);
+}
+
+void example_checksum_scrubber()
+{
+    bench_checksum_cost<false>("/dev/shm/crc_plain.shm");
+    bench_checksum_cost<true>("/dev/shm/crc_checked.shm");
+
+    // Scrub the checksummed container at idle priority
+    ShmContainerConsumer<NseTicker, uint32_t, NoHeaderInfo, 4, true> cons(
+        10'000'000, "/dev/shm/crc_checked.shm");
+    ShmChecksumScrubber scrubber(cons);
+    std::atomic<bool> stop {false};
+    std::thread scrub_thread([&]{
+        scrubber.run(stop, [](size_t idx) {printf("corrupt record %zu\n", idx);});
+    });
+    while(!scrubber.passes())
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    stop = true;
+    scrub_thread.join();
+    printf("scrubbed %llu records, %llu corrupt, %llu busy\n",
+           (unsigned long long)scrubber.scanned(), (unsigned long long)scrubber.corrupt(),
+           (unsigned long long)scrubber.busy_skipped());
+}
+
+// Throughput cost of durable mode against pure tmpfs.
+void example_durable_mode(char const* disk_path = "/var/tmp/nse_tickers.shm")
+{
+    size_t const N = 20'000'000;
+    for(char const* path : {"/dev/shm/nse_tickers_tmpfs.shm", disk_path})
+        {
+        bool const durable = path == disk_path;
+        ::unlink(path);
+        ShmContainerProducer<NseTicker> prod(N, path);
+        ShmDurableSyncer syncer(prod);
+        std::atomic<bool> stop {false};
+        std::thread sync_thread;
+        if(durable)
+            sync_thread = std::thread([&]{ syncer.run(stop); });
+
+        uint64_t const t0 = steady_now_ns();
+        for(uint32_t ii = 0; ii < N; ++ii)
+            {
+            auto vptr = prod.emplace_back();
+            *vptr = NseTicker{ii, ii, ii, ii};
+            }
+        uint64_t const elapsed_ns = steady_now_ns() - t0;
+        stop = true;
+        if(durable)
+            sync_thread.join();
+        printf("%-6s %.1f M rec/s, durable %zu of %zu after %llu syncs\n",
+               durable ? "msync" : "tmpfs", N * 1e3 / elapsed_ns, prod.durable_size(),
+               prod.size(), (unsigned long long)syncer.syncs());
+        }
+}
+
+// Last-K history of an in-place updated record.
+void example_history()
+{
+    using Producer = ShmContainerProducer<NseTicker, uint32_t, NoHeaderInfo, 4, false, 4>;
+    using Consumer = ShmContainerConsumer<NseTicker, uint32_t, NoHeaderInfo, 4, false, 4>;
+    Producer prod(1000, "/tmp/nse_tickers_hist.shm");
+    Consumer cons(1000, "/tmp/nse_tickers_hist.shm");
+
+    prod.emplace_back()->bid_px = 39000;
+    for(uint32_t px = 39001; px <= 39010; ++px)
+        prod.produce_begin(0)->bid_px = px; // each update is a new version
+
+    NseTicker last[4];
+    uint32_t versions[4];
+    size_t const n = cons.copy_history(0, last, versions);
+    for(size_t ii = 0; ii < n; ++ii)
+        printf("version %u: bid_px %u\n", versions[ii], last[ii].bid_px);
+
+    NseTicker as_of;
+    if(cons.try_copy_version(0, versions[0] - 1, as_of))
+        printf("previous bid_px %u\n", as_of.bid_px);
+}
+
+// Commit throughput with 1..N producer threads, one shard each.
+void example_sharded_scaling(size_t max_threads = std::thread::hardware_concurrency())
+{
+    size_t const per_thread = 5'000'000;
+    size_t last_run = 1;
+    for(size_t threads = 1; threads <= std::max<size_t>(1, max_threads); threads *= 2)
+        {
+        last_run = threads;
+        for(size_t shard = 0; shard < threads; ++shard) // start empty
+            ::unlink(shard_file_path("/dev/shm/nse_tickers_sharded", shard).c_str());
+        ShmShardedProducer<ShmContainerProducer<NseTicker>> shards(
+            threads, per_thread, "/dev/shm/nse_tickers_sharded");
+        std::vector<std::thread> producers;
+        uint64_t const t0 = steady_now_ns();
+        for(size_t shard = 0; shard < threads; ++shard)
+            producers.emplace_back([&shards, shard, per_thread]
+                {
+                auto& prod = shards.shard(shard);
+                for(uint32_t ii = 0; ii < per_thread; ++ii)
+                    {
+                    auto vptr = prod.emplace_back();
+                    *vptr = NseTicker{ii, ii, ii, ii};
+                    }
+                });
+        for(auto& thread : producers)
+            thread.join();
+        uint64_t const elapsed_ns = steady_now_ns() - t0;
+        printf("%2zu producer threads: %.1f M commits/s\n",
+               threads, threads * per_thread * 1e3 / elapsed_ns);
+        }
+
+    // Merged read-back of the last run, ordered by bid_px
+    auto const by_bid = [](NseTicker const& lhs, NseTicker const& rhs) {return lhs.bid_px < rhs.bid_px;};
+    ShmShardedConsumer<ShmContainerConsumer<NseTicker>> cons(
+        last_run, per_thread, "/dev/shm/nse_tickers_sharded");
+    auto cursor = cons.merge(by_bid);
+    ShardedIndex at;
+    NseTicker obj;
+    size_t merged = 0;
+    while(cursor.next(at, obj))
+        ++merged;
+    printf("merged %zu of %zu records\n", merged, cons.size());
+}
+
+// Example record with an event timestamp
+struct TimedTick
+{
+    uint64_t ts_ns;
+    uint32_t px;
+    uint32_t qty;
+};
+
+// Merged records/sec for three exchange feeds on one core.
+void example_merge_feeds()
+{
+    size_t const N = 10'000'000;
+    char const* const paths[] = {"/dev/shm/nse.shm", "/dev/shm/bse.shm", "/dev/shm/mcx.shm"};
+    std::vector<ShmContainerConsumer<TimedTick>> feeds;
+    for(size_t feed = 0; feed < 3; ++feed)
+        {
+        ::unlink(paths[feed]);
+        ShmContainerProducer<TimedTick> prod(N, paths[feed]);
+        for(uint32_t ii = 0; ii < N; ++ii) // interleaved timestamps
+            *prod.emplace_back() = TimedTick{3ull * ii + feed, ii, uint32_t(feed)};
+        feeds.emplace_back(N, paths[feed]);
+        }
+
+    auto const time_of = [](TimedTick const& tick) {return tick.ts_ns;};
+    ShmMergeConsumer<ShmContainerConsumer<TimedTick>, decltype(time_of)> merged(
+        {&feeds[0], &feeds[1], &feeds[2]}, time_of);
+    size_t src, index;
+    TimedTick tick;
+    uint64_t prev_ts = 0, out_of_order = 0;
+    uint64_t const t0 = steady_now_ns();
+    while(merged.next(src, index, tick))
+        {
+        out_of_order += tick.ts_ns < prev_ts;
+        prev_ts = tick.ts_ns;
+        }
+    uint64_t const elapsed_ns = steady_now_ns() - t0;
+    printf("merged %llu records: %.1f M rec/s, %llu out of order\n",
+           (unsigned long long)merged.stats().emitted,
+           merged.stats().emitted * 1e3 / elapsed_ns, (unsigned long long)out_of_order);
+}
+
+// 1s and 1m bars for 100 instruments from a tick stream.
+void example_bar_builder()
+{
+    size_t const N = 5'000'000;
+    ::unlink("/dev/shm/ticks.shm");
+    ::unlink("/dev/shm/bars.shm");
+    ShmContainerProducer<TimedTick> ticks_prod(N, "/dev/shm/ticks.shm");
+    ShmContainerConsumer<TimedTick> ticks(N, "/dev/shm/ticks.shm");
+    ShmBarProducer bars(1'000'000, "/dev/shm/bars.shm");
+    for(uint32_t ii = 0; ii < N; ++ii) // qty doubles as the instrument id
+        *ticks_prod.emplace_back() = TimedTick{ii * 100'000ull, 10'000 + ii % 977, ii % 100};
+
+    auto const tick_of = [](TimedTick const& tick)
+        {return BarTick{tick.qty, tick.ts_ns, double(tick.px), 1.0};};
+    ShmBarBuilder builder(ticks, bars, 100, {1'000'000'000ull, 60'000'000'000ull}, tick_of);
+    uint64_t const t0 = steady_now_ns();
+    while(builder.poll_once()) {}
+    uint64_t const elapsed_ns = steady_now_ns() - t0;
+
+    ShmBarConsumer bar_reader(1'000'000, "/dev/shm/bars.shm");
+    BarHeader const& hdr = bar_reader.user_header();
+    auto const live = bar_reader.consume_begin(hdr.live_bar_index(7, 1)).get_copy();
+    printf("%.1f M ticks/s, %llu bars closed; instrument 7 live 1m bar: "
+           "O %.0f H %.0f L %.0f C %.0f VWAP %.1f\n",
+           N * 1e3 / elapsed_ns, (unsigned long long)builder.bars_closed(),
+           live.open, live.high, live.low, live.close, live.vwap);
+}
+
+// Top-10 bid quantity leaders across 5000 instruments, updated in place.
+void example_top_n()
+{
+    size_t const M = 5000;
+    ::unlink("/dev/shm/top10_bid_qx.shm");
+    ShmContainerProducer<NseTicker> prod(M, "/dev/shm/nse_tickers_topn.shm");
+    auto const by_bid_qx = [](NseTicker const& t) {return double(t.bid_qx);};
+    ShmTopN<NseTicker, 10, decltype(by_bid_qx)> top(M, "/dev/shm/top10_bid_qx.shm", by_bid_qx);
+    ShmTopNConsumer<10> view(1, "/dev/shm/top10_bid_qx.shm");
+    while(prod.size() < M)
+        prod.emplace_back();
+
+    uint64_t rng = 88172645463325252ull;
+    size_t const updates = 10'000'000;
+    uint64_t const t0 = steady_now_ns();
+    for(size_t ii = 0; ii < updates; ++ii)
+        {
+        rng ^= rng << 13; rng ^= rng >> 7; rng ^= rng << 17;
+        size_t const idx = rng % M;
+        NseTicker const tick {uint32_t(rng), 1, uint32_t(rng >> 20), uint32_t(rng >> 40) % 100000};
+        *prod.produce_begin(idx) = tick;
+        top.on_update(idx, tick);
+        }
+    uint64_t const elapsed_ns = steady_now_ns() - t0;
+
+    auto const ranked = view.consume_begin(0).get_copy();
+    printf("%.1f ns/update, republished on %.2f%% of updates; leader #%llu qty %.0f\n",
+           double(elapsed_ns) / updates, 100.0 * top.publishes() / updates,
+           (unsigned long long)ranked.entries[0].index, ranked.entries[0].score);
+}
+
+// Update and top-5 read latency on 100 instruments with 1000-level ladders.
+void example_order_book()
+{
+    uint32_t const instruments = 100, levels = 1000;
+    ::unlink(book_levels_path("/dev/shm/nse_book").c_str());
+    ::unlink(book_sides_path("/dev/shm/nse_book").c_str());
+    ShmOrderBookProducer book(instruments, levels, "/dev/shm/nse_book");
+    ShmOrderBookConsumer reader(instruments, levels, "/dev/shm/nse_book");
+    for(uint32_t inst = 0; inst < instruments; ++inst)
+        book.set_ladder(inst, 10'000);
+
+    size_t const N = 2'000'000;
+    std::vector<uint32_t> update_ns, read_ns;
+    update_ns.reserve(N);
+    read_ns.reserve(N / 10);
+    uint64_t rng = 0x2545F4914F6CDD1Dull;
+    ShmOrderBookConsumer::Quote top5[5];
+    for(size_t ii = 0; ii < N; ++ii)
+        {
+        rng ^= rng << 13; rng ^= rng >> 7; rng ^= rng << 17;
+        bool const bid = rng & 1;
+        int64_t const px = 10'500 + (bid ? -1 : 1) * int64_t(1 + (rng >> 8) % 50);
+        BookMsg const msg {BookMsg::eType((rng >> 32) % 3), bid ? eBookSide::BID : eBookSide::ASK,
+                           uint32_t((rng >> 16) % instruments), px, int64_t(1 + (rng >> 40) % 100)};
+        uint64_t const t0 = steady_now_ns();
+        book.apply(msg);
+        uint64_t const t1 = steady_now_ns();
+        update_ns.push_back(t1 - t0);
+        if(ii % 10 == 0)
+            {
+            reader.top_k(msg.instrument, msg.side, top5, 5);
+            read_ns.push_back(steady_now_ns() - t1);
+            }
+        }
+    for(auto* lat : {&update_ns, &read_ns})
+        {
+        std::sort(lat->begin(), lat->end());
+        printf("%s ns: p50 %u  p99 %u  p99.9 %u\n", lat == &update_ns ? "update" : "top-5 ",
+               (*lat)[lat->size() / 2], (*lat)[lat->size() * 99 / 100], (*lat)[lat->size() * 999 / 1000]);
+        }
+    auto const bbo = reader.bbo(0);
+    printf("instrument 0: %lld x %lld  /  %lld x %lld\n", (long long)bbo.bid.qty,
+           (long long)bbo.bid.px, (long long)bbo.ask.px, (long long)bbo.ask.qty);
+}
+
+// Expire most of a reference-data container, reuse and compact its slots.
+void example_erase_compact()
+{
+    ::unlink("/dev/shm/contracts.shm");
+    ::unlink("/dev/shm/contracts.fwd");
+    ShmContainerProducer<NseTicker> prod(1'000'000, "/dev/shm/contracts.shm");
+    ShmContainerProducer<ForwardEntry> fwd_log(1'000'000, "/dev/shm/contracts.fwd");
+    ShmContainerConsumer<NseTicker> cons(1'000'000, "/dev/shm/contracts.shm");
+    ShmForwardingResolver resolver(1'000'000, "/dev/shm/contracts.fwd");
+
+    for(uint32_t ii = 0; ii < 100'000; ++ii)
+        *prod.emplace_back() = NseTicker{ii, ii, ii, ii};
+    uint64_t const cached_gen = cons.compaction_gen();
+    size_t const cached_idx = 99'996; // some consumer remembers this one
+
+    for(size_t ii = 0; ii < 100'000; ++ii) // expire 3 out of 4
+        if(ii % 4)
+            prod.erase(ii);
+    size_t reused;
+    *prod.emplace(reused) = NseTicker{7, 7, 7, 7};
+
+    size_t const moved = prod.compact(fwd_log);
+    uint64_t gen = cached_gen;
+    size_t const now_at = resolver.resolve(cached_idx, gen);
+    NseTicker obj {};
+    cons.try_copy(now_at, obj);
+    printf("reused slot %zu; compacted %zu moves, size %zu; record %zu is now at %zu (bid_px %u)\n",
+           reused, moved, prod.size(), cached_idx, now_at, obj.bid_px);
+}
+
+// Secondary index on bid_px: range lookups vs. scanning every record.
+void example_secondary_index()
+{
+    constexpr size_t N = 1'000'000;
+    ::unlink("/dev/shm/tickers_ix.shm");
+    ::unlink("/dev/shm/tickers_ix.bpx");
+    size_t const max_nodes = N / 4;
+    ShmContainerProducer<NseTicker> prod(N, "/dev/shm/tickers_ix.shm");
+    ShmBTreeIndex<int32_t> index(max_nodes, "/dev/shm/tickers_ix.bpx");
+    ShmContainerConsumer<NseTicker> cons(N, "/dev/shm/tickers_ix.shm");
+    ShmBTreeReader<int32_t> reader(max_nodes, "/dev/shm/tickers_ix.bpx");
+
+    uint64_t rng = 0x2545F4914F6CDD1Dull;
+    uint64_t const t0 = steady_now_ns();
+    for(uint32_t ii = 0; ii < N; ++ii)
+        {
+        rng ^= rng << 13; rng ^= rng >> 7; rng ^= rng << 17;
+        uint32_t const px = 30'000 + rng % 20'000;
+        *prod.emplace_back() = NseTicker{px + 5, 10, px, 10};
+        index.insert(int32_t(px), ii);
+        }
+    uint64_t const t1 = steady_now_ns();
+
+    size_t via_index = 0, via_scan = 0;
+    for(int32_t lo = 30'000; lo < 50'000; lo += 2'000)
+        via_index += reader.range(lo, lo + 9, [&cons](int32_t, uint64_t idx)
+            {NseTicker obj; cons.try_copy(idx, obj);});
+    uint64_t const t2 = steady_now_ns();
+    NseTicker obj;
+    for(int32_t lo = 30'000; lo < 50'000; lo += 2'000)
+        for(size_t idx = 0; idx < cons.size(); ++idx)
+            via_scan += cons.try_copy(idx, obj) && obj.bid_px >= uint32_t(lo) && obj.bid_px <= uint32_t(lo + 9);
+    uint64_t const t3 = steady_now_ns();
+
+    printf("indexed %zu records in %.1f ns/insert, %zu nodes, height %zu\n",
+           N, double(t1 - t0) / N, index.nodes(), index.height());
+    printf("10 range lookups: index %zu hits in %.1f us, scan %zu hits in %.1f us\n",
+           via_index, (t2 - t1) / 1e3, via_scan, (t3 - t2) / 1e3);
+}
+
+// Per-instrument history and as-of lookups over one interleaved tick log.
+void example_key_chain()
+{
+    constexpr size_t   N = 1'000'000;
+    constexpr uint32_t INSTRUMENTS = 64;
+    ::unlink("/dev/shm/tick_log.shm");
+    ::unlink("/dev/shm/tick_log.shm.heads");
+    auto const key_of  = [](BarTick const& tick) {return tick.instrument;};
+    auto const time_of = [](BarTick const& tick) {return tick.ts_ns;};
+    ShmKeyChainProducer<BarTick, decltype(key_of)> log(N, INSTRUMENTS, "/dev/shm/tick_log.shm", key_of);
+    ShmKeyChainConsumer<BarTick, decltype(time_of)> hist(N, INSTRUMENTS, "/dev/shm/tick_log.shm", time_of);
+
+    uint64_t rng = 0x2545F4914F6CDD1Dull;
+    for(size_t ii = 0; ii < N; ++ii)
+        {
+        rng ^= rng << 13; rng ^= rng >> 7; rng ^= rng << 17;
+        log.append(BarTick{uint32_t(rng % INSTRUMENTS), ii * 1'000, double(ii), 1.0});
+        }
+
+    BarTick last[100];
+    uint64_t const t0 = steady_now_ns();
+    size_t const got = hist.latest(7, last, 100);
+    uint64_t const t1 = steady_now_ns();
+    constexpr size_t LOOKUPS = 10'000;
+    size_t found = 0;
+    BarTick tick;
+    for(size_t ii = 0; ii < LOOKUPS; ++ii)
+        found += hist.as_of(uint32_t(ii % INSTRUMENTS), (ii * 7'919 % N) * 1'000, tick);
+    uint64_t const t2 = steady_now_ns();
+    printf("instrument 7: %llu ticks, last %zu in %.1f us, newest ts %llu\n",
+           (unsigned long long)hist.count(7), got, (t1 - t0) / 1e3, (unsigned long long)last[0].ts_ns);
+    printf("%zu as-of lookups, %zu found, %.0f ns each\n", LOOKUPS, found, double(t2 - t1) / LOOKUPS);
+}
+
+// Full snapshot of a live container through the C ABI vs. over TCP.
+void bench_c_abi_vs_socket()
+{
+    size_t const N = 1'000'000;
+    ::unlink("/dev/shm/abi_src.shm");
+    ::unlink("/dev/shm/abi_dst.shm");
+    ShmContainerProducer<NseTicker> source(N, "/dev/shm/abi_src.shm");
+    for(uint32_t ii = 0; ii < N; ++ii)
+        *source.emplace_back() = NseTicker{ii, ii, ii, ii};
+
+    mex_consumer* const cons = mex_open("/dev/shm/abi_src.shm");
+    std::vector<NseTicker> out(N);
+    uint64_t const t0 = steady_now_ns();
+    uint64_t const copied = mex_copy_committed(cons, 0, N, out.data(), nullptr);
+    uint64_t const t1 = steady_now_ns();
+    mex_close(cons);
+
+    ShmContainerConsumer<NseTicker> tail(N, "/dev/shm/abi_src.shm");
+    ShmContainerProducer<NseTicker> mirror(N, "/dev/shm/abi_dst.shm");
+    std::atomic<bool> stop {false};
+    ShmReplicationSender sender(tail, "127.0.0.1", 15065);
+    std::thread send_thread([&]{ sender.run(stop); });
+    ShmReplicationReceiver receiver(mirror, "127.0.0.1", 15065);
+    uint64_t const t2 = steady_now_ns();
+    std::thread recv_thread([&]{ receiver.run(stop); });
+    while(receiver.expected_index() < N)
+        std::this_thread::yield();
+    uint64_t const t3 = steady_now_ns();
+    stop = true;
+    send_thread.join();
+    recv_thread.join();
+
+    printf("C ABI snapshot: %llu records in %.2f ms (%.1f ns/rec)\n",
+           (unsigned long long)copied, (t1 - t0) / 1e6, double(t1 - t0) / N);
+    printf("TCP snapshot:   %zu records in %.2f ms (%.1f ns/rec), %.0fx\n",
+           N, (t3 - t2) / 1e6, double(t3 - t2) / N, double(t3 - t2) / (t1 - t0));
+}
+
+// Hardware effects of the Record/Header layout: produce, consume and scan,
+// plus a tailing reader racing the producer for the same cache lines.
+void bench_hw_counters()
+{
+    size_t const N = 10'000'000;
+    ::unlink("/dev/shm/hw_counters.shm");
+    ShmContainerProducer<NseTicker> prod(N, "/dev/shm/hw_counters.shm");
+    ShmContainerConsumer<NseTicker> cons(N, "/dev/shm/hw_counters.shm");
+    if(!PerfCounters().available())
+        printf("hardware counters unavailable (perf_event_paranoid or seccomp), timing only\n");
+
+    bench_case("produce", N, [&]
+        {
+        for(uint32_t ii = 0; ii < N; ++ii)
+            *prod.emplace_back() = NseTicker{ii, ii, ii, ii};
+        });
+    uint64_t sum = 0;
+    NseTicker obj;
+    bench_case("consume sequential", N, [&]
+        {
+        for(size_t ii = 0; ii < N; ++ii)
+            if(cons.try_copy(ii, obj))
+                sum += obj.bid_px;
+        });
+    bench_case("consume random", N, [&]
+        {
+        uint64_t rng = 0x2545F4914F6CDD1Dull;
+        for(size_t ii = 0; ii < N; ++ii)
+            {
+            rng ^= rng << 13; rng ^= rng >> 7; rng ^= rng << 17;
+            if(cons.try_copy(rng % N, obj))
+                sum += obj.bid_px;
+            }
+        });
+    std::vector<NseTicker> batch(4096);
+    bench_case("scan copy_committed", N, [&]
+        {
+        for(size_t first = 0; first < N; )
+            {
+            size_t const got = cons.copy_committed(first, batch.size(), batch.data());
+            sum += batch[got - 1].bid_px;
+            first += got;
+            }
+        });
+
+    // Counters are per thread: measured on the reader, which takes the misses
+    size_t const M = 1'000'000;
+    ::unlink("/dev/shm/hw_counters_tail.shm");
+    ShmContainerProducer<NseTicker> live(M, "/dev/shm/hw_counters_tail.shm");
+    ShmContainerConsumer<NseTicker> tail(M, "/dev/shm/hw_counters_tail.shm");
+    std::thread reader([&]
+        {
+        bench_case("tail while producing", M, [&]
+            {
+            for(size_t ii = 0; ii < M; )
+                if(ii < tail.size() && tail.try_copy(ii, obj))
+                    sum += obj.bid_px, ++ii;
+            });
+        });
+    for(uint32_t ii = 0; ii < M; ++ii)
+        *live.emplace_back() = NseTicker{ii, ii, ii, ii};
+    reader.join();
+    printf("(sum %llu)\n", (unsigned long long)sum);
+}
+
+// What-if simulation on a private copy-on-write clone of live state.
+void example_what_if(char const* reflink_dir = "/var/tmp")
+{
+    size_t const N = 10'000'000;
+    ::unlink("/dev/shm/what_if.shm");
+    ShmContainerProducer<NseTicker> live(N, "/dev/shm/what_if.shm");
+    for(uint32_t ii = 0; ii < N; ++ii)
+        *live.emplace_back() = NseTicker{ii, ii, ii, ii};
+    ShmContainerConsumer<NseTicker> cons(N, "/dev/shm/what_if.shm");
+
+    uint64_t const t0 = steady_now_ns();
+    auto sim = cons.clone_private();
+    uint64_t const t1 = steady_now_ns();
+    rusage before {}, after {};
+    ::getrusage(RUSAGE_SELF, &before);
+    for(size_t ii = 0; ii < N; ii += 10'000) // hypothetical fills
+        sim.produce_begin(ii)->bid_qx = 0;
+    ::getrusage(RUSAGE_SELF, &after);
+
+    NseTicker in_live;
+    cons.try_copy(20'000, in_live);
+    uint32_t const in_sim = sim.produce_begin(20'000)->bid_qx;
+    printf("cloned %zu records in %.1f us; %zu updates copied %ld pages; bid_qx live %u, sim %u\n",
+           N, (t1 - t0) / 1e3, N / 10'000, after.ru_minflt - before.ru_minflt, in_live.bid_qx, in_sim);
+
+    std::string const src_path   = std::string(reflink_dir) + "/what_if.shm";
+    std::string const clone_path = std::string(reflink_dir) + "/what_if.reflink";
+    ::unlink(src_path.c_str());
+    ::unlink(clone_path.c_str());
+    ShmContainerProducer<NseTicker> on_disk(1000, src_path);
+    *on_disk.emplace_back() = NseTicker{1, 2, 3, 4};
+    try
+        {
+        on_disk.clone_reflink(clone_path);
+        ShmContainerProducer<NseTicker> reopened(1000, clone_path);
+        printf("reflinked clone holds %zu records\n", reopened.size());
+        }
+    catch(std::system_error const& ex)
+        {
+        printf("no reflink in %s: %s\n", reflink_dir, ex.what());
+        }
+}
+
+// Per-field dirty masks: a consumer that only reacts to bid_px changes.
+void example_dirty_fields()
+{
+    size_t const N = 1000;
+    ::unlink("/dev/shm/dirty_tickers.shm");
+    ShmContainerProducer<NseTicker, uint32_t, NoHeaderInfo, 4, false, 0, true> prod(N, "/dev/shm/dirty_tickers.shm");
+    ShmContainerConsumer<NseTicker, uint32_t, NoHeaderInfo, 4, false, 0, true> cons(N, "/dev/shm/dirty_tickers.shm");
+    *prod.emplace_back() = NseTicker{41000, 77, 39000, 55};
+
+    uint32_t seen_ver = 0; // INVALID_VERSION: nothing seen yet
+    NseTicker obj;
+    uint64_t changed = 0;
+    size_t bid_changes = 0;
+    for(uint32_t ii = 0; ii < 100; ++ii)
+        {
+        {
+            auto vptr = prod.produce_begin(0);
+            vptr.set<&NseTicker::bid_qx>(ii);              // changes every time
+            vptr.set<&NseTicker::bid_px>(39000 + ii / 10); // changes every 10th
+        }
+        if(cons.try_copy_changes(0, obj, seen_ver, changed) && (changed & field_bit<&NseTicker::bid_px>()))
+            ++bid_changes; // the first read reports all fields
+        }
+    printf("100 updates, bid_px changed in %zu of them (expect 10), last mask %#llx\n",
+           bid_changes, (unsigned long long)changed);
+}
+
+// Version width: 16-bit versions shrink every record, 64-bit ones never wrap.
+template<typename T_Version>
+void bench_version_width(char const* file_path)
+{
+    size_t const N = 1'000'000;
+    ::unlink(file_path);
+    ShmContainerProducer<NseTicker, T_Version> prod(N, file_path);
+    ShmContainerConsumer<NseTicker, T_Version> cons(N, file_path);
+    for(uint32_t ii = 0; ii < N; ++ii)
+        *prod.emplace_back() = NseTicker{ii, ii, ii, ii};
+
+    uint64_t sum = 0;
+    NseTicker obj;
+    auto const t0 = steady_now_ns();
+    for(int pass = 0; pass < 10; ++pass)
+        for(size_t ii = 0; ii < N; ++ii)
+            if(cons.try_copy(ii, obj))
+                sum += obj.bid_px;
+    double const ns = double(steady_now_ns() - t0) / (10.0 * N);
+    uint32_t const stride = prod.record_layout().record_stride;
+    printf("%2zu-bit versions: %2u B/record, %6.1f MB per 1M records, %5.2f ns/record, %6.0f MB/s (sum %llu)\n",
+           8 * sizeof(T_Version), stride, stride * double(N) / 1e6, ns, stride / ns * 1e3,
+           (unsigned long long)sum);
+    ::unlink(file_path);
+}
+
+void example_version_width()
+{
+    bench_version_width<uint16_t>("/dev/shm/ver16_tickers.shm");
+    bench_version_width<uint32_t>("/dev/shm/ver32_tickers.shm");
+    bench_version_width<uint64_t>("/dev/shm/ver64_tickers.shm");
+
+    // A 16-bit version laps after 32767 updates: the record stays readable
+    // and the header epoch tells readers that started before it apart.
+    ::unlink("/dev/shm/ver16_wrap.shm");
+    ShmContainerProducer<NseTicker, uint16_t> prod(1, "/dev/shm/ver16_wrap.shm");
+    ShmContainerConsumer<NseTicker, uint16_t> cons(1, "/dev/shm/ver16_wrap.shm");
+    *prod.emplace_back() = NseTicker{};
+    uint16_t ver = 0;
+    for(uint32_t ii = 0; ii < 100'000; ++ii)
+        *prod.produce_begin(0) = NseTicker{ii, ii, ii, ii};
+    NseTicker obj;
+    bool const ok = cons.try_copy(0, obj, &ver);
+    printf("100000 updates of a 16-bit record: readable %d, version %u, bid_px %u\n",
+           ok, ver, obj.bid_px);
+    ::unlink("/dev/shm/ver16_wrap.shm");
+}
+
+// Seqlock torture with 16- and 32-bit versions, returns non-zero on a torn read.
+int example_torture(TortureConfig const& cfg = {})
+{
+    bool passed = true;
+    auto const print = [&](char const* name, TortureReport const& rep)
+        {
+        printf("%s: %llu writes, %llu reads, %llu mid-write sleeps, %llu signals, %llu torn: %s\n",
+               name, (unsigned long long)rep.writes, (unsigned long long)rep.reads,
+               (unsigned long long)rep.stalls, (unsigned long long)rep.signals,
+               (unsigned long long)rep.torn, rep.passed() ? "PASS" : "FAIL");
+        for(auto const* hist : {&rep.retries, &rep.latency_ns})
+            printf("  %-10s p50 %llu  p99 %llu  p99.9 %llu  p99.99 %llu  max %llu\n",
+                   hist == &rep.retries ? "retries" : "latency ns",
+                   (unsigned long long)hist->percentile(0.5), (unsigned long long)hist->percentile(0.99),
+                   (unsigned long long)hist->percentile(0.999), (unsigned long long)hist->percentile(0.9999),
+                   (unsigned long long)hist->max);
+        passed &= rep.passed();
+        };
+    print("16-bit versions", run_torture<uint16_t>("/dev/shm/torture16.shm", cfg));
+    print("32-bit versions", run_torture<uint32_t>("/dev/shm/torture32.shm", cfg));
+    return passed ? 0 : 1;
+}
+
+// Attach cost of a huge, sparsely touched container: full-capacity mapping
+// vs a 16-chunk window. Page tables come from VmPTE in /proc/self/status.
+void bench_windowed_consumer(char const* file_path = "/dev/shm/huge_tickers.shm")
+{
+    auto const vm_pte_kb = []
+        {
+        FILE* const status = ::fopen("/proc/self/status", "r");
+        char line[256];
+        long kb = -1;
+        while(status && fgets(line, sizeof(line), status))
+            if(1 == sscanf(line, "VmPTE: %ld kB", &kb))
+                break;
+        if(status)
+            ::fclose(status);
+        return kb;
+        };
+    size_t const capacity = 40'000'000'000; // ~1 TB, sparse
+    size_t const touched  = 10'000;         // one record every ~4 MB
+    size_t const spread   = capacity / touched;
+    ::unlink(file_path);
+    {
+        ShmContainerProducer<NseTicker> prod(capacity, file_path);
+        for(uint32_t ii = 0; ii < touched; ++ii)
+            *prod.produce_begin(ii * spread) = NseTicker{ii, ii, ii, ii};
+    }
+    std::vector<size_t> order(touched);
+    uint64_t rng = 0x2545F4914F6CDD1Dull;
+    for(size_t ii = 0; ii < touched; ++ii)
+        {
+        rng ^= rng << 13; rng ^= rng >> 7; rng ^= rng << 17;
+        order[ii] = (rng % touched) * spread;
+        }
+
+    auto const run = [&](char const* name, auto attach)
+        {
+        long const pte0 = vm_pte_kb();
+        uint64_t const t0 = steady_now_ns();
+        auto cons = attach();
+        uint64_t const t1 = steady_now_ns();
+        uint64_t sum = 0;
+        NseTicker obj;
+        for(size_t idx : order)
+            if(cons->try_copy(idx, obj))
+                sum += obj.bid_px;
+        uint64_t const t2 = steady_now_ns();
+        long const pte1 = vm_pte_kb();
+        cons.reset();
+        uint64_t const t3 = steady_now_ns();
+        printf("%-9s attach %7.1f us  %6.0f ns/read  page tables +%6ld kB  detach %8.1f us (sum %llu)\n",
+               name, (t1 - t0) / 1e3, double(t2 - t1) / touched, pte1 - pte0, (t3 - t2) / 1e3,
+               (unsigned long long)sum);
+        };
+    run("full", [&] {return std::make_unique<ShmContainerConsumer<NseTicker>>(capacity, file_path);});
+    run("windowed", [&] {return std::make_unique<ShmWindowedConsumer<NseTicker>>(capacity, file_path);});
+    ::unlink(file_path);
+}
+
+// Cold historical scan of a container on disk: plain faulting reads vs
+// scan() with readahead and drop-behind. Reports bandwidth and how much of
+// the file is left in the page cache afterwards.
+void bench_historical_scan(char const* disk_path = "/var/tmp/tick_history.shm")
+{
+    size_t const N = 20'000'000;
+    ::unlink(disk_path);
+    {
+        ShmContainerProducer<NseTicker> prod(N, disk_path);
+        for(uint32_t ii = 0; ii < N; ++ii)
+            *prod.emplace_back() = NseTicker{ii, ii, ii, ii};
+    }
+    auto const with_file = [disk_path](auto body)
+        {
+        int const fd = ::open(disk_path, O_RDONLY);
+        struct stat st {};
+        ::fstat(fd, &st);
+        auto const res = body(fd, size_t(st.st_size));
+        ::close(fd);
+        return res;
+        };
+    auto const evict = [&]
+        {
+        return with_file([](int fd, size_t bytes)
+            {return ::fdatasync(fd) | ::posix_fadvise(fd, 0, off_t(bytes), POSIX_FADV_DONTNEED);});
+        };
+    auto const cached_mb = [&]
+        {
+        return with_file([](int fd, size_t bytes)
+            {
+            static size_t const page = ::sysconf(_SC_PAGESIZE);
+            void* const mem = ::mmap(nullptr, bytes, PROT_READ, MAP_SHARED, fd, 0);
+            std::vector<unsigned char> vec((bytes + page - 1) / page);
+            size_t resident = 0;
+            if(MAP_FAILED != mem && 0 == ::mincore(mem, bytes, vec.data()))
+                for(unsigned char v : vec)
+                    resident += v & 1;
+            if(MAP_FAILED != mem)
+                ::munmap(mem, bytes);
+            return resident * page / 1e6;
+            });
+        };
+
+    ShmContainerConsumer<NseTicker> cons(N, disk_path);
+    double const file_mb = N * cons.record_layout().record_stride / 1e6;
+    auto const run = [&](char const* name, auto body)
+        {
+        evict();
+        uint64_t sum = 0;
+        uint64_t const t0 = steady_now_ns();
+        size_t const seen = body(sum);
+        double const secs = (steady_now_ns() - t0) / 1e9;
+        printf("%-26s %zu records, %7.1f MB/s, %6.1f of %.1f MB left in page cache (sum %llu)\n",
+               name, seen, file_mb / secs, cached_mb(), file_mb, (unsigned long long)sum);
+        };
+    run("faulting try_copy", [&](uint64_t& sum)
+        {
+        NseTicker obj;
+        for(size_t ii = 0; ii < N; ++ii)
+            if(cons.try_copy(ii, obj))
+                sum += obj.bid_px;
+        return N;
+        });
+    run("scan, readahead only", [&](uint64_t& sum)
+        {
+        ScanConfig cfg;
+        cfg.drop_behind = false;
+        return cons.scan(0, N, [&](size_t, NseTicker const& obj) {sum += obj.bid_px;}, cfg);
+        });
+    run("scan, readahead+drop", [&](uint64_t& sum)
+        {return cons.scan(0, N, [&](size_t, NseTicker const& obj) {sum += obj.bid_px;});});
+    ::unlink(disk_path);
+}
+
+// Query DSL vs the same passes written by hand over copy_committed() batches.
+void bench_query_dsl()
+{
+    size_t const N = 10'000'000;
+    ::unlink("/dev/shm/query_tickers.shm");
+    ShmContainerProducer<NseTicker> prod(N, "/dev/shm/query_tickers.shm");
+    ShmContainerConsumer<NseTicker> cons(N, "/dev/shm/query_tickers.shm");
+    uint64_t rng = 0x2545F4914F6CDD1Dull;
+    for(size_t ii = 0; ii < N; ++ii)
+        {
+        rng ^= rng << 13; rng ^= rng >> 7; rng ^= rng << 17;
+        uint32_t const bid = 39000 + uint32_t(rng % 1000);
+        *prod.emplace_back() = NseTicker{bid + uint32_t(rng >> 20) % 10, uint32_t(rng >> 32) % 200,
+                                         bid, uint32_t(rng >> 40) % 200};
+        }
+
+    auto const tight = field<&NseTicker::bid_qx> > 100u
+                    && field<&NseTicker::ask_px> - field<&NseTicker::bid_px> < 5u;
+    auto const by_hand = [&](auto&& body)
+        {
+        std::vector<NseTicker> batch(ShmQuery<decltype(cons)>::BATCH);
+        for(size_t first = 0, got; first < N; first += got)
+            {
+            got = cons.copy_committed(first, batch.size(), batch.data());
+            body(batch.data(), got);
+            }
+        };
+    uint64_t count = 0, volume = 0;
+    uint32_t best = 0;
+    bench_case("count, hand loop", N, [&]
+        {
+        count = 0;
+        by_hand([&](NseTicker const* recs, size_t n)
+            {
+            for(size_t ii = 0; ii < n; ++ii)
+                count += (recs[ii].bid_qx > 100) & (recs[ii].ask_px - recs[ii].bid_px < 5);
+            });
+        });
+    printf("  %llu matched\n", (unsigned long long)count);
+    bench_case("count, query", N, [&]
+        {count = ShmQuery(cons).where(tight).count();});
+    printf("  %llu matched\n", (unsigned long long)count);
+
+    bench_case("3 aggregates, hand loop", N, [&]
+        {
+        count = volume = best = 0;
+        by_hand([&](NseTicker const* recs, size_t n)
+            {
+            for(size_t ii = 0; ii < n; ++ii)
+                {
+                bool const keep = (recs[ii].bid_qx > 100) & (recs[ii].ask_px - recs[ii].bid_px < 5);
+                count  += keep;
+                volume += keep ? recs[ii].bid_qx : 0;
+                best    = keep && best < recs[ii].ask_px ? recs[ii].ask_px : best;
+                }
+            });
+        });
+    printf("  %llu matched, volume %llu, max ask %u\n", (unsigned long long)count,
+           (unsigned long long)volume, best);
+    bench_case("3 aggregates, query", N, [&]
+        {
+        std::tie(count, volume, best) = ShmQuery(cons).where(tight).aggregate(
+            count_of(), sum_of(field<&NseTicker::bid_qx>), max_of(field<&NseTicker::ask_px>));
+        });
+    printf("  %llu matched, volume %llu, max ask %u\n", (unsigned long long)count,
+           (unsigned long long)volume, best);
+
+    std::unordered_map<uint32_t, uint64_t> by_bucket;
+    bench_case("group by, hand loop", N, [&]
+        {
+        by_bucket.clear();
+        by_hand([&](NseTicker const* recs, size_t n)
+            {
+            for(size_t ii = 0; ii < n; ++ii)
+                if((recs[ii].bid_qx > 100) & (recs[ii].ask_px - recs[ii].bid_px < 5))
+                    by_bucket[recs[ii].bid_px % 16] += recs[ii].bid_qx;
+            });
+        });
+    printf("  %zu groups, bucket 0 volume %llu\n", by_bucket.size(), (unsigned long long)by_bucket[0]);
+    decltype(ShmQuery(cons).group_by(field<&NseTicker::bid_px> % 16u, sum_of(field<&NseTicker::bid_qx>))) groups;
+    bench_case("group by, query", N, [&]
+        {groups = ShmQuery(cons).where(tight).group_by(field<&NseTicker::bid_px> % 16u, sum_of(field<&NseTicker::bid_qx>));});
+    printf("  %zu groups, bucket 0 volume %llu\n", groups.size(), (unsigned long long)std::get<0>(groups[0]));
+
+    std::vector<uint32_t> spreads;
+    bench_case("project, query", N, [&]
+        {
+        spreads.clear();
+        ShmQuery(cons).where(tight).project(field<&NseTicker::ask_px> - field<&NseTicker::bid_px>, spreads);
+        });
+    printf("  %zu spreads projected\n", spreads.size());
+    ::unlink("/dev/shm/query_tickers.shm");
+}
+
+// Enrichment join of ticks against 1M instruments of reference data:
+// batched and prefetched, the same without prefetch, and the per-consumer
+// std::unordered_map it replaces.
+struct KeyedTick
+{
+    uint64_t instrument;
+    uint32_t px;
+    uint32_t qty;
+};
+struct InstrumentRef
+{
+    uint64_t instrument;
+    uint32_t lot_size;
+    uint32_t tick_size;
+    uint32_t type;
+    uint32_t reserved;
+};
+struct EnrichedTick
+{
+    uint64_t instrument;
+    uint32_t px;
+    uint32_t lots;       // qty / lot_size
+    uint32_t tick_size;
+    uint32_t type;       // ~0u: unknown instrument
+};
+
+void example_enrichment_join()
+{
+    size_t const INSTRUMENTS = 1'000'000, TICKS = 5'000'000;
+    for(char const* path : {"/dev/shm/instruments.shm", "/dev/shm/instruments.shm.keys",
+                            "/dev/shm/keyed_ticks.shm", "/dev/shm/enriched_ticks.shm"})
+        ::unlink(path);
+    auto const key_of_ref = [](InstrumentRef const& ref) {return ref.instrument;};
+    ShmKeyedRefProducer<InstrumentRef, decltype(key_of_ref)> ref_prod(INSTRUMENTS, "/dev/shm/instruments.shm", key_of_ref);
+    std::vector<uint64_t> ids(INSTRUMENTS);
+    std::unordered_map<uint64_t, InstrumentRef> local_map;
+    for(uint32_t ii = 0; ii < INSTRUMENTS; ++ii)
+        {
+        ids[ii] = 0x494e450000000000ull + uint64_t(ii) * 7919; // sparse, ISIN-like ids
+        InstrumentRef const ref {ids[ii], 1 + ii % 100, 5, ii % 4, 0};
+        ref_prod.upsert(ref);
+        local_map.emplace(ref.instrument, ref);
+        }
+    ShmKeyedRefReader<InstrumentRef> refs(INSTRUMENTS, "/dev/shm/instruments.shm");
+
+    ShmContainerProducer<KeyedTick> tick_prod(TICKS, "/dev/shm/keyed_ticks.shm");
+    ShmContainerConsumer<KeyedTick> ticks(TICKS, "/dev/shm/keyed_ticks.shm");
+    uint64_t rng = 0x2545F4914F6CDD1Dull;
+    for(uint32_t ii = 0; ii < TICKS; ++ii)
+        {
+        rng ^= rng << 13; rng ^= rng >> 7; rng ^= rng << 17;
+        uint64_t const id = ii % 1000 ? ids[rng % INSTRUMENTS] : 42; // 0.1% unknown
+        *tick_prod.emplace_back() = KeyedTick{id, 40000 + uint32_t(rng >> 48) % 100, 100 * (1 + uint32_t(rng >> 40) % 50)};
+        }
+
+    auto const key_of_tick = [](KeyedTick const& tick) {return tick.instrument;};
+    auto const enrich = [](KeyedTick const& tick, InstrumentRef const* ref, EnrichedTick& out)
+        {
+        out = ref ? EnrichedTick{tick.instrument, tick.px, tick.qty / ref->lot_size, ref->tick_size, ref->type}
+                  : EnrichedTick{tick.instrument, tick.px, 0, 0, ~0u};
+        };
+    for(bool prefetch : {false, true})
+        {
+        ::unlink("/dev/shm/enriched_ticks.shm");
+        ShmContainerProducer<EnrichedTick> out(TICKS, "/dev/shm/enriched_ticks.shm");
+        ShmEnrichJoin<decltype(ticks), InstrumentRef, decltype(out), decltype(key_of_tick), decltype(enrich)>
+            join(ticks, refs, out, key_of_tick, enrich, prefetch);
+        uint64_t const t0 = steady_now_ns();
+        while(join.ticks_consumed() < TICKS)
+            join.poll_once();
+        double const ns = double(steady_now_ns() - t0) / TICKS;
+        printf("shm join, %-11s %6.1f ns/tick, %llu unknown\n", prefetch ? "prefetch" : "no prefetch",
+               ns, (unsigned long long)join.misses());
+        }
+
+    // The status quo: each consumer's own map, no shared index
+    ::unlink("/dev/shm/enriched_ticks.shm");
+    ShmContainerProducer<EnrichedTick> out(TICKS, "/dev/shm/enriched_ticks.shm");
+    std::vector<KeyedTick> batch(256);
+    uint64_t misses = 0;
+    uint64_t const t0 = steady_now_ns();
+    for(size_t first = 0, got; first < TICKS; first += got)
+        {
+        got = ticks.copy_committed(first, batch.size(), batch.data());
+        for(size_t ii = 0; ii < got; ++ii)
+            {
+            auto const it = local_map.find(batch[ii].instrument);
+            misses += local_map.end() == it;
+            enrich(batch[ii], local_map.end() == it ? nullptr : &it->second, *out.emplace_back());
+            }
+        }
+    printf("unordered_map join     %6.1f ns/tick, %llu unknown\n",
+           double(steady_now_ns() - t0) / TICKS, (unsigned long long)misses);
+    for(char const* path : {"/dev/shm/instruments.shm", "/dev/shm/instruments.shm.keys",
+                            "/dev/shm/keyed_ticks.shm", "/dev/shm/enriched_ticks.shm"})
+        ::unlink(path);
+}
+
+// A GUI tailing the full tick stream vs sampling 1000 instruments every
+// 100 ms, CPU time of each while a producer runs at ~1M ticks/s.
+void example_sampled_view()
+{
+    size_t const INSTRUMENTS = 10'000, RATE = 1'000'000, SECONDS = 2;
+    ::unlink("/dev/shm/latest_tickers.shm");
+    ::unlink("/dev/shm/tick_stream.shm");
+    ShmContainerProducer<NseTicker> latest(INSTRUMENTS, "/dev/shm/latest_tickers.shm");
+    ShmContainerProducer<KeyedTick> stream(RATE * SECONDS * 2, "/dev/shm/tick_stream.shm");
+    for(size_t ii = 0; ii < INSTRUMENTS; ++ii)
+        latest.emplace_back();
+    ShmContainerConsumer<NseTicker> latest_cons(INSTRUMENTS, "/dev/shm/latest_tickers.shm");
+    ShmContainerConsumer<KeyedTick> stream_cons(RATE * SECONDS * 2, "/dev/shm/tick_stream.shm");
+    auto const thread_cpu_ns = []
+        {
+        timespec ts {};
+        ::clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+        return uint64_t(ts.tv_sec) * 1'000'000'000 + ts.tv_nsec;
+        };
+
+    std::atomic<bool> stop {false};
+    uint64_t tail_cpu = 0, tail_ticks = 0, sample_cpu = 0;
+    std::thread tailer([&]
+        {
+        std::vector<NseTicker> screen(INSTRUMENTS);
+        std::vector<KeyedTick> batch(1024);
+        uint64_t const cpu0 = thread_cpu_ns();
+        while(!stop.load(std::memory_order_relaxed))
+            {
+            size_t const got = stream_cons.copy_committed(tail_ticks, batch.size(), batch.data());
+            for(size_t ii = 0; ii < got; ++ii)
+                screen[batch[ii].instrument] = NseTicker{batch[ii].px, batch[ii].qty, batch[ii].px, batch[ii].qty};
+            tail_ticks += got;
+            if(!got)
+                std::this_thread::yield();
+            }
+        tail_cpu = thread_cpu_ns() - cpu0;
+        });
+    std::vector<size_t> watched(1000);
+    for(size_t ii = 0; ii < watched.size(); ++ii)
+        watched[ii] = ii * (INSTRUMENTS / watched.size());
+    ShmSampledView view(latest_cons, watched, 100'000'000);
+    std::thread sampler([&]
+        {
+        std::vector<NseTicker> screen(INSTRUMENTS);
+        uint64_t const cpu0 = thread_cpu_ns();
+        view.run(stop, [&](size_t idx, NseTicker const& obj) {screen[idx] = obj;});
+        sample_cpu = thread_cpu_ns() - cpu0;
+        });
+
+    uint64_t rng = 0x2545F4914F6CDD1Dull;
+    uint64_t const t0 = steady_now_ns();
+    for(uint64_t ii = 0; ii < RATE * SECONDS; ++ii)
+        {
+        rng ^= rng << 13; rng ^= rng >> 7; rng ^= rng << 17;
+        uint32_t const inst = uint32_t(rng % INSTRUMENTS);
+        uint32_t const px = 40000 + uint32_t(rng >> 48) % 100;
+        *latest.produce_begin(inst) = NseTicker{px, 100, px, 100};
+        *stream.emplace_back() = KeyedTick{inst, px, 100};
+        if(0 == ii % 1000) // pace to RATE
+            while(steady_now_ns() - t0 < ii * 1'000'000'000 / RATE)
+                std::this_thread::sleep_for(std::chrono::microseconds(100));
+        }
+    stop = true;
+    tailer.join();
+    sampler.join();
+    double const wall_ns = double(steady_now_ns() - t0);
+    printf("full tail : %8.1f ms CPU (%5.1f%% of a core), %llu ticks\n", tail_cpu / 1e6,
+           100.0 * tail_cpu / wall_ns, (unsigned long long)tail_ticks);
+    printf("sampled   : %8.1f ms CPU (%5.1f%% of a core), %llu samples, %llu records delivered\n",
+           sample_cpu / 1e6, 100.0 * sample_cpu / wall_ns, (unsigned long long)view.samples(),
+           (unsigned long long)view.delivered());
 
+    // With nothing new each selected record costs one version load
+    size_t const N = 1000;
+    uint64_t const s0 = steady_now_ns();
+    for(size_t ii = 0; ii < N; ++ii)
+        view.sample([](size_t, NseTicker const&) {});
+    printf("quiet sample of %zu records: %.2f ns/record\n", watched.size(),
+           double(steady_now_ns() - s0) / (N * watched.size()));
+    ::unlink("/dev/shm/latest_tickers.shm");
+    ::unlink("/dev/shm/tick_stream.shm");
 }